@@ -0,0 +1,78 @@
+/* Exercise the C interface against the words test lexicon */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "zyzzyva-dawg.h"
+
+static int print(void *context, char const *word, size_t length)
+{
+    int *limit = context;
+    printf("%s %zu\n", word, length);
+    return limit && --*limit == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char buffer[16];
+    int limit = 3;
+    int truncated = -1;
+    zdawg_limits limits = { 0, 0, 2 };
+    zdawg *dawg = zdawg_open(argc > 1 ? argv[1] : "");
+    if (!dawg) {
+        return 1;
+    }
+
+    printf("lookup CAT %d\n", zdawg_lookup(dawg, "CAT"));
+    printf("lookup CA %d\n", zdawg_lookup(dawg, "CA"));
+    printf("prefix %ld\n", zdawg_prefix(dawg, "NEWS", buffer, sizeof(buffer), print, NULL));
+    printf("anagram %ld\n", zdawg_anagram(dawg, "AEINRST", buffer, sizeof(buffer), print, &limit));
+    printf("pattern %ld\n", zdawg_pattern(dawg, "Q*", buffer, sizeof(buffer), print, NULL));
+    printf("small buffer %ld\n", zdawg_prefix(dawg, "STATION", buffer, 8, print, NULL));
+    printf("limited %ld", zdawg_search(dawg, "pattern", "Q*", &limits, &truncated, buffer, sizeof(buffer), print, NULL));
+    printf(" truncated %d\n", truncated);
+    printf("query %ld", zdawg_search(dawg, "query", "len:4 prefix:QU", NULL, &truncated, buffer, sizeof(buffer), print, NULL));
+    printf(" truncated %d\n", truncated);
+    zdawg_close(dawg);
+
+    /* The same node array, loaded by the caller */
+    FILE *f = fopen(argv[1], "rb");
+    uint32_t count;
+    if (!f || fread(&count, sizeof(count), 1, f) != 1) {
+        return 1;
+    }
+    uint32_t *nodes = malloc(count * sizeof(uint32_t));
+    if (fread(nodes, sizeof(uint32_t), count, f) != count || !(dawg = zdawg_open_memory(nodes, count))) {
+        return 1;
+    }
+    fclose(f);
+    printf("memory pattern %ld\n", zdawg_pattern(dawg, "?UZZ", buffer, sizeof(buffer), print, NULL));
+    zdawg_close(dawg);
+    free(nodes);
+
+    /* A lexicon created with an alphabet, read and written in its letters */
+    if (argc > 3) {
+        char definition[1024];
+        FILE *alphabet = fopen(argv[3], "r");
+        size_t length = alphabet ? fread(definition, 1, sizeof(definition) - 1, alphabet) : 0;
+        if (!alphabet || !(dawg = zdawg_open(argv[2]))) {
+            return 1;
+        }
+        fclose(alphabet);
+        definition[length] = '\0';
+        printf("alphabet %d\n", zdawg_alphabet(dawg, definition));
+        printf("alphabet lookup CAÑA %d\n", zdawg_lookup(dawg, "CAÑA"));
+        printf("alphabet pattern %ld\n", zdawg_pattern(dawg, "C???", buffer, sizeof(buffer), print, NULL));
+        printf("alphabet query %ld", zdawg_search(dawg, "query", "prefix:LL", NULL, &truncated, buffer, sizeof(buffer), print, NULL));
+        printf(" truncated %d\n", truncated);
+        zdawg_close(dawg);
+    }
+
+    /* A corrupt file is refused rather than opened */
+    if (argc > 4) {
+        dawg = zdawg_open(argv[4]);
+        printf("corrupt %s\n", dawg ? "opened" : "refused");
+        zdawg_close(dawg);
+    }
+    return 0;
+}
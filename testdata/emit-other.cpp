@@ -0,0 +1,10 @@
+// A second file including the header emitted by emit-cpp, which must share its table
+
+#include <cstdint>
+
+#include "words.h"
+
+std::uint32_t const *otherNodes()
+{
+    return words_dawg::nodes;
+}
@@ -0,0 +1,36 @@
+// Check that a lexicon compiled in by emit-cpp can be used, including at compile time
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "words.h"
+
+static_assert(words_dawg::Lexicon::contains("CAT"), "CAT is in the lexicon");
+static_assert(words_dawg::Lexicon::contains("NEWSPAPERS"), "NEWSPAPERS is in the lexicon");
+static_assert(!words_dawg::Lexicon::contains("CA"), "CA is not in the lexicon");
+static_assert(!words_dawg::Lexicon::contains("CATCHIER"), "CATCHIER is not in the lexicon");
+
+std::uint32_t const *otherNodes();
+
+int main(int argc, char *argv[])
+{
+    // Every file that includes the header sees the same table
+    if (otherNodes() != words_dawg::nodes) {
+        std::printf("nodes: FAIL\n");
+        return 1;
+    }
+
+    // Every word in the original list must be found
+    std::ifstream words(argc > 1 ? argv[1] : "");
+    int count = 0;
+    for (std::string word; words >> word; ++count) {
+        if (!words_dawg::Lexicon::contains(word.c_str()) ||
+            words_dawg::Lexicon::contains((word + "Q").c_str())) {
+            std::printf("%s: FAIL\n", word.c_str());
+            return 1;
+        }
+    }
+    return count ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+// Check the range over the words of a lexicon, used directly from C++
+
+#define ZYZZYVA_DAWG_LIBRARY
+#include "zyzzyva-dawg.cpp"
+
+static int fail(char const *what)
+{
+    std::printf("%s: FAIL\n", what);
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    Dawg::Lexicon lexicon(argc > 1 ? argv[1] : "");
+
+    // Every word, in order, as the word list has them
+    std::ifstream list(argc > 2 ? argv[2] : "");
+    std::vector<std::string> expected { std::istream_iterator<std::string>(list), std::istream_iterator<std::string>() };
+    auto all = Dawg::words(lexicon.view());
+    if (!std::equal(expected.begin(), expected.end(), all.begin()) ||
+        size_t(std::distance(all.begin(), all.end())) != expected.size()) {
+        return fail("words");
+    }
+
+    // A search that stops part way, after which the iterator carries on from there
+    auto found = std::find(all.begin(), all.end(), "CATCH");
+    if (found == all.end() || *found != "CATCH" || *++found != "CATCHY") {
+        return fail("find");
+    }
+    if (std::find(all.begin(), all.end(), "CATCHIER") != all.end()) {
+        return fail("find missing");
+    }
+
+    // Just the words with a prefix, or none at all
+    auto cat = Dawg::words(lexicon.view(), "CAT");
+    std::vector<std::string> prefixed(cat.begin(), cat.end());
+    if (prefixed != std::vector<std::string> { "CAT", "CATCH", "CATCHY", "CATS" }) {
+        return fail("prefix");
+    }
+    auto none = Dawg::words(lexicon.view(), "QX");
+    if (none.begin() != none.end()) {
+        return fail("empty prefix");
+    }
+    return 0;
+}
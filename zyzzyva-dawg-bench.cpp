@@ -0,0 +1,287 @@
+/** Microbenchmarks for the inner loops of zyzzyva-dawg
+ *
+ *  Each benchmark runs one stage of building or reading a DAWG in isolation:
+ *  the node hash, the edge list hash, probing the hash table in insertEdges(),
+ *  splitting a word list in WordBuffer::next(), the checksum loop and the
+ *  search for a letter in an edge list.  They run on a synthetic word list and
+ *  on any word lists named on the command line, each repeated until it has run
+ *  for long enough to time, and report the time per operation together with
+ *  the cycles, instructions, cache misses and branch misses counted by the
+ *  kernel's perf_event_open(), where it is available.
+ *
+ *  This code is Copyright (C) Stewart Brodie, 2019
+ */
+
+#define ZYZZYVA_DAWG_LIBRARY
+#include "zyzzyva-dawg.cpp"
+
+#include <iomanip>
+#include <random>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+namespace {
+    /* A group of hardware counters read together.  If the kernel does not allow
+     * them (no PMU, as in many virtual machines, or a strict perf_event_paranoid
+     * setting), they are simply reported as unavailable.
+     */
+    struct Counters {
+        static constexpr size_t count = 4;
+
+        Counters() {
+            static const uint64_t events[count] = {
+                PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+            };
+            for (size_t i = 0; i < count; ++i) {
+                perf_event_attr attr;
+                std::memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.config = events[i];
+                attr.disabled = i == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP;
+                fds[i] = ::syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0);
+                if (fds[i] < 0) {
+                    close();
+                    return;
+                }
+            }
+        }
+
+        ~Counters() { close(); }
+
+        bool available() const { return fds[0] >= 0; }
+
+        void start() {
+            if (available()) {
+                ::ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+        }
+
+        // Stop counting and add the counts since start() to the totals
+        void stop(std::array<uint64_t, count>& totals) {
+            if (available()) {
+                ::ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+                uint64_t values[count + 1] = {}; // the number of counters, then each count
+                if (::read(fds[0], values, sizeof(values)) == ssize_t(sizeof(values))) {
+                    for (size_t i = 0; i < count; ++i) {
+                        totals[i] += values[i + 1];
+                    }
+                }
+            }
+        }
+
+    private:
+        void close() {
+            for (auto& fd : fds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+                fd = -1;
+            }
+        }
+
+        int fds[count] { -1, -1, -1, -1 };
+    };
+
+    // The input to every benchmark, derived from one word list
+    struct Input {
+        Input(std::string const& name, std::string const& text) : name(name), text(text) {
+            std::istringstream words(text);
+            dawg.parse(words);
+            auto nodes = dawg.view();
+
+            // Every edge list below the root, as insertEdges() sees them
+            std::vector<Dawg::Node const *> starts;
+            Dawg::Dawg::EdgeList list;
+            for (size_t idx = Dawg::ZyzzyvaLayout::root_size; idx < nodes.size(); ++idx) {
+                if (list.edges.empty()) {
+                    starts.push_back(&nodes[idx]);
+                }
+                list.edges.push_back(nodes[idx]);
+                if (nodes[idx].isEndOfNode()) {
+                    lists.push_back(std::move(list));
+                    list.edges.clear();
+                }
+            }
+
+            // Letters to look for in the root list and in lists chosen at random, half
+            // of them taken from the list and half of them any letter at all
+            std::mt19937 random(2019);
+            for (size_t idx = 0; idx < 1000000; ++idx) {
+                auto start = idx % 2 || starts.empty() ? nodes.begin() : starts[random() % starts.size()];
+                size_t length = 1;
+                while (start[length - 1].getChar() != 0 && !start[length - 1].isEndOfNode()) {
+                    ++length;
+                }
+                unsigned char c = idx % 4 < 2 ? start[random() % length].getChar() : 'A' + random() % 26;
+                finds.emplace_back(start, c ? c : 'A');
+            }
+        }
+
+        std::string name;
+        std::string text;
+        Dawg::Dawg dawg;
+        std::vector<Dawg::Dawg::EdgeList> lists;
+        std::vector<std::pair<Dawg::Node const *, unsigned char>> finds;
+    };
+
+    // A word list with the shape of a real lexicon: many short words sharing prefixes
+    std::string synthetic(size_t words) {
+        std::mt19937 random(2019);
+        std::set<std::string> unique;
+        while (unique.size() < words) {
+            std::string word;
+            for (size_t length = 2 + random() % 6 + random() % 6; word.size() < length; ) {
+                word.push_back('A' + std::min<unsigned>(random() % 26, random() % 26));
+            }
+            unique.insert(word);
+        }
+        std::string text;
+        for (auto const& word : unique) {
+            text += word + "\n";
+        }
+        return text;
+    }
+
+    /* Run a stage repeatedly until it has taken at least 0.2s, preparing it
+     * outside the timing each time, and print its cost per operation.  The
+     * stage returns how many operations it did, and a value that depends on
+     * its work so that the compiler cannot leave the work out.
+     */
+    template <class Prepare, class Stage>
+    void measure(std::string const& stage, Input const& input, Prepare const& prepare, Stage const& run) {
+        typedef std::chrono::steady_clock Clock;
+        static Counters counters;
+        static volatile uint64_t sink;
+        std::array<uint64_t, Counters::count> totals {};
+        Clock::duration elapsed {};
+        uint64_t operations = 0;
+        do {
+            prepare();
+            auto start = Clock::now();
+            counters.start();
+            auto result = run();
+            counters.stop(totals);
+            elapsed += Clock::now() - start;
+            operations += result.first;
+            sink = sink + result.second;
+        } while (elapsed < std::chrono::milliseconds(200));
+
+        auto ns = std::chrono::duration<double, std::nano>(elapsed).count();
+        std::cout << std::left << std::setw(24) << stage << std::setw(16) << input.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << ns / operations;
+        for (auto total : totals) {
+            if (counters.available()) {
+                std::cout << std::setw(12) << double(total) / operations;
+            }
+            else {
+                std::cout << std::setw(12) << "-";
+            }
+        }
+        std::cout << "\n";
+    }
+
+    void benchmark(Input const& input) {
+        auto nothing = [] {};
+        auto nodes = input.dawg.view();
+
+        measure("Node::hash_fn", input, nothing, [&] {
+            return std::make_pair(uint64_t(nodes.size()),
+                                  std::accumulate(nodes.begin(), nodes.end(), uint32_t(0), Dawg::Node::hash_fn));
+        });
+
+        measure("EdgeList::hash", input, nothing, [&] {
+            uint64_t sum = 0;
+            for (auto const& list : input.lists) {
+                sum += list.hash();
+            }
+            return std::make_pair(uint64_t(input.lists.size()), sum);
+        });
+
+        // Every list is new to an empty DAWG, and then found again in a full one.  The
+        // hash table is allocated by the first insertion, so that one is left untimed.
+        std::unique_ptr<Dawg::Dawg> fresh;
+        auto empty = [&] {
+            fresh.reset(new Dawg::Dawg);
+            if (!input.lists.empty()) {
+                fresh->insertEdges(input.lists.front());
+            }
+        };
+        measure("insertEdges (new)", input, empty, [&] {
+            uint64_t sum = 0;
+            for (auto const& list : input.lists) {
+                sum += fresh->insertEdges(list);
+            }
+            return std::make_pair(uint64_t(input.lists.size()), sum);
+        });
+        measure("insertEdges (existing)", input, nothing, [&] {
+            uint64_t sum = 0;
+            for (auto const& list : input.lists) {
+                sum += fresh->insertEdges(list);
+            }
+            return std::make_pair(uint64_t(input.lists.size()), sum);
+        });
+
+        std::unique_ptr<std::istringstream> text;
+        measure("WordBuffer::next", input, [&] { text.reset(new std::istringstream(input.text)); }, [&] {
+            Dawg::WordBuffer words(*text);
+            uint64_t count = 0, sum = 0;
+            for (auto word = words.next(); !word.second.empty(); word = words.next()) {
+                ++count;
+                sum += word.first;
+            }
+            return std::make_pair(count, sum);
+        });
+
+        measure("View::checksum", input, nothing, [&] {
+            return std::make_pair(uint64_t(nodes.size()), uint64_t(nodes.checksum()));
+        });
+
+        measure("View::find", input, nothing, [&] {
+            uint64_t sum = 0;
+            for (auto const& find : input.finds) {
+                sum += Dawg::View::find(find.first, find.second) != nullptr;
+            }
+            return std::make_pair(uint64_t(input.finds.size()), sum);
+        });
+    }
+} // namespace
+
+int main(int argc, char *argv[]) {
+    try {
+        std::vector<std::unique_ptr<Input>> inputs;
+        inputs.emplace_back(new Input("synthetic", synthetic(200000)));
+        for (int i = 1; i < argc; ++i) {
+            std::ifstream in(argv[i], std::ios::in);
+            if (!in) {
+                throw std::runtime_error(std::string("Unable to open ") + argv[i]);
+            }
+            std::ostringstream text;
+            text << in.rdbuf();
+            std::string name { argv[i] };
+            inputs.emplace_back(new Input(name.substr(name.find_last_of('/') + 1), text.str()));
+        }
+
+        std::cout << std::left << std::setw(24) << "stage" << std::setw(16) << "input" << std::right << std::setw(12)
+                  << "ns/op" << std::setw(12) << "cycles/op" << std::setw(12) << "instr/op" << std::setw(12)
+                  << "cache-miss" << std::setw(12) << "branch-miss" << "\n";
+        for (auto const& input : inputs) {
+            benchmark(*input);
+        }
+        if (!Counters().available()) {
+            std::cout << "\nHardware counters are not available here, so only times are shown\n";
+        }
+        return 0;
+    }
+    catch (std::exception const& e) {
+        std::cerr << "Exception: " << e.what() << "\n";
+        return 1;
+    }
+}
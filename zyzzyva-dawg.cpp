@@ -14,16 +14,46 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <exception>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <istream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "zyzzyva-dawg.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
 namespace Dawg {
 
 namespace {
@@ -36,67 +66,594 @@ namespace {
     std::ostream& output(std::ostream& os, uint32_t value) {
         return os.write(reinterpret_cast<char *>(&value), sizeof(uint32_t));
     }
-} // namespace
 
-struct Node {
+    // Write out an array of 32-bit words to the specified stream
+    std::ostream& output(std::ostream& os, std::vector<uint32_t> const& values) {
+        return os.write(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(uint32_t));
+    }
 
-    Node() = default;
-    Node(unsigned char letter, bool ends_word) :
-        value((uint32_t(letter) << letter_shift) | (ends_word ? end_of_word : 0)) {}
+    unsigned concurrency() {
+        auto threads = std::thread::hardware_concurrency();
+        return threads ? threads : 1;
+    }
 
-    bool isEndOfWord() const { return (value & end_of_word) != 0; }
-    bool isEndOfNode() const { return (value & end_of_node) != 0; }
-    uint32_t getOffset() const { return (value & offset_mask); }
-    unsigned char getChar() const { return (value & letter_mask) >> letter_shift; }
-    Node& setEndOfNode() { value |= end_of_node; return *this; }
-    Node& setChildOffset(uint32_t node) { value |= (node & offset_mask); return *this; }
+    // Call fn(worker, item) for items 0 .. count-1, handing them out to a pool of
+    // threads on demand.  Each worker is numbered so that it can keep its own results.
+    template <class F>
+    void parallelFor(size_t count, unsigned workers, F const& fn) {
+        std::atomic<size_t> next { 0 };
+        auto worker = [&](unsigned id) {
+            for (size_t item; (item = next++) < count; ) {
+                fn(id, item);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned id = 1; id < workers; ++id) {
+            threads.emplace_back(worker, id);
+        }
+        worker(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+    }
 
-    bool operator==(Node const& other) const { return value == other.value; }
-    void write(std::ostream& os) const { output(os, value); }
-    static uint32_t hash_fn(uint32_t r, Node n) { return n.value ^ ((r << 1) | (r >> 31)); };
+    // Sort chunks of the range in parallel and then merge them back together
+    template <class It, class Compare>
+    void parallelSort(It first, It last, Compare cmp) {
+        size_t chunks = std::min<size_t>(concurrency(), std::distance(first, last) / 4096 + 1);
+        std::vector<It> bounds;
+        for (size_t i = 0; i <= chunks; ++i) {
+            bounds.push_back(first + std::distance(first, last) * i / chunks);
+        }
+        parallelFor(chunks, chunks, [&](unsigned, size_t i) { std::sort(bounds[i], bounds[i + 1], cmp); });
+        for (size_t width = 1; width < chunks; width *= 2) {
+            size_t merges = (chunks + 2 * width - 1) / (2 * width);
+            parallelFor(merges, merges, [&](unsigned, size_t i) {
+                size_t lo = 2 * width * i, mid = lo + width, hi = std::min(lo + 2 * width, chunks);
+                if (mid < hi) {
+                    std::inplace_merge(bounds[lo], bounds[mid], bounds[hi], cmp);
+                }
+            });
+        }
+    }
+} // namespace
+
+// A read-only memory mapping of an entire file or shared memory segment
+struct MappedFile {
+    explicit MappedFile(std::string const& path, bool shared_memory = false) {
+        int fd = shared_memory ? ::shm_open(path.c_str(), O_RDONLY, 0) : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            length = st.st_size;
+            address = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (!address || address == MAP_FAILED) {
+            throw std::runtime_error("Unable to map " + path);
+        }
+    }
+    ~MappedFile() { ::munmap(address, length); }
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    char const *data() const { return static_cast<char const *>(address); }
+    size_t size() const { return length; }
 
 private:
+    void *address { nullptr };
+    size_t length { 0 };
+};
+
+/* The layout of a node in Zyzzyva's file format: an 8-bit letter, flags for the
+ * end of a word and the end of an edge list, and the offset of the child edge
+ * list (plus one).  The node, builder, loader and traversal code all take the
+ * layout as a template parameter, so that any other layout gets inner loops
+ * compiled specifically for it and costs the Zyzzyva layout nothing.
+ */
+struct ZyzzyvaLayout {
     static constexpr uint32_t letter_mask  = 0xff000000u;
     static constexpr uint32_t end_of_word  = 0x00800000u;
     static constexpr uint32_t end_of_node  = 0x00400000u;
     static constexpr uint32_t reserve_bit  = 0x00200000u;
     static constexpr uint32_t offset_mask  = 0x001fffffu;
     static constexpr uint32_t letter_shift = 24u;
+    static constexpr uint32_t root_size    = MAX_CHARS;
+    static constexpr uint32_t magic        = 0u; // no header
+    static constexpr size_t hash_table_size = HASH_TABLE_SIZE;
+
+    static char const *name() { return "zyzzyva"; }
+};
+
+/* A layout for lexicons of up to 31 letters, which are stored as their codes in
+ * an alphabet.  Five bits are enough for the letter and there is no reserved
+ * bit, which leaves 25 bits for the offset, so a DAWG can have 32M nodes rather
+ * than 2M in the same memory.  The file starts with a header recording the
+ * alphabet, as the codes mean nothing without it.
+ */
+struct WideLayout {
+    static constexpr uint32_t letter_mask  = 0xf8000000u;
+    static constexpr uint32_t end_of_word  = 0x04000000u;
+    static constexpr uint32_t end_of_node  = 0x02000000u;
+    static constexpr uint32_t offset_mask  = 0x01ffffffu;
+    static constexpr uint32_t letter_shift = 27u;
+    static constexpr uint32_t root_size    = 32u;
+    static constexpr uint32_t magic        = 0x57474457u; // "WDGW"
+    static constexpr size_t hash_table_size = 8388617u;
+
+    static char const *name() { return "wide"; }
+};
+
+template <class Layout>
+struct BasicNode {
 
+    BasicNode() = default;
+    BasicNode(unsigned char letter, bool ends_word) :
+        value((uint32_t(letter) << Layout::letter_shift) | (ends_word ? Layout::end_of_word : 0)) {}
+
+    bool isEndOfWord() const { return (value & Layout::end_of_word) != 0; }
+    bool isEndOfNode() const { return (value & Layout::end_of_node) != 0; }
+    uint32_t getOffset() const { return (value & Layout::offset_mask); }
+    unsigned char getChar() const { return (value & Layout::letter_mask) >> Layout::letter_shift; }
+    BasicNode& setEndOfNode() { value |= Layout::end_of_node; return *this; }
+    BasicNode& setChildOffset(uint32_t node) { value |= (node & Layout::offset_mask); return *this; }
+    BasicNode& clearChildOffset() { value &= ~Layout::offset_mask; return *this; }
+
+    uint32_t getValue() const { return value; }
+
+    bool operator==(BasicNode const& other) const { return value == other.value; }
+    void write(std::ostream& os) const { output(os, value); }
+    static uint32_t hash_fn(uint32_t r, BasicNode n) { return n.value ^ ((r << 1) | (r >> 31)); };
+
+private:
     uint32_t value { 0 };
 };
 
+typedef BasicNode<ZyzzyvaLayout> Node;
+
+// A read-only view of a DAWG node array, wherever that array happens to live
+template <class Layout>
+struct BasicView {
+    typedef BasicNode<Layout> Node;
+
+    BasicView() = default;
+    BasicView(Node const *nodes, size_t size) : nodes(nodes), count(size) {}
+
+    size_t size() const { return count; }
+    Node const *begin() const { return nodes; }
+    Node const *end() const { return nodes + count; }
+    Node const& operator[](size_t idx) const { return nodes[idx]; }
+    Node const& at(size_t idx) const {
+        if (idx >= count) {
+            throw std::out_of_range("node " + std::to_string(idx) + " is outside the DAWG");
+        }
+        return nodes[idx];
+    }
+
+    size_t indexOf(Node const *node) const { return node - nodes; }
+
+    // Zyzzyva's CRC of the node array
+    uint32_t checksum() const {
+        static const uint32_t crc_tbl[16] = {
+            0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+            0x8408, 0x9489, 0xa50a, 0xb58b, 0xc60c, 0xd68d, 0xe70e, 0xf78f,
+        };
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(nodes);
+        size_t bytes = count; // copy Zyzzyva bug
+        uint32_t crc = 0xffffu;
+
+        while (bytes--) {
+            uint8_t c = *p++;
+            crc = ((crc >> 4) & 0x0fff) ^ crc_tbl[((crc ^ c) & 15)];
+            c >>= 4;
+            crc = ((crc >> 4) & 0x0fff) ^ crc_tbl[((crc ^ c) & 15)];
+        }
+
+        return (~crc) & 0xffffu;
+    }
+
+    // A hash of every node (FNV-1a, a node at a time), which tells apart lexicons
+    // that Zyzzyva's checksum would not
+    uint64_t fingerprint() const {
+        uint64_t hash = 0xcbf29ce484222325u;
+        for (size_t idx = 0; idx < count; ++idx) {
+            hash = (hash ^ nodes[idx].getValue()) * 0x100000001b3u;
+        }
+        return hash;
+    }
+
+    // The edge list below a node, or nullptr if the node has no children
+    Node const *children(Node const *node) const {
+        auto next = node->getOffset();
+        return next ? &at(next - 1) : nullptr;
+    }
+
+    // Search an edge list for a letter.  The padding at the end of the root list
+    // has letter zero, so stop there rather than scanning all 256 entries.
+    static Node const *find(Node const *list, unsigned char c) {
+        for (; list && list->getChar() != 0; ++list) {
+            if (list->getChar() == c) {
+                return list;
+            }
+            if (list->isEndOfNode()) {
+                break;
+            }
+        }
+        return nullptr;
+    }
+
+    // Follow a string from the root, returning the node for its final letter
+    Node const *walk(std::string const& word) const {
+        Node const *node = nullptr;
+        Node const *list = nodes;
+        for (unsigned char c : word) {
+            if (!(node = find(list, c))) {
+                break;
+            }
+            list = children(node);
+        }
+        return node;
+    }
+
+    bool contains(std::string const& word) const {
+        auto node = word.empty() ? nullptr : walk(word);
+        return node && node->isEndOfWord();
+    }
+
+    // Call fn(length) with the length of each word that the text from 'first' starts with,
+    // shortest first, walking forward until no edge matches.  Each byte of the text is
+    // translated through 'table' first, if there is one.
+    template <class F>
+    void wordsAt(char const *first, char const *last, F const& fn, unsigned char const *table = nullptr) const {
+        Node const *list = nodes;
+        for (auto text = first; text != last && list; ++text) {
+            auto c = static_cast<unsigned char>(*text);
+            auto node = find(list, table ? table[c] : c);
+            if (!node) {
+                break;
+            }
+            if (node->isEndOfWord()) {
+                fn(size_t(text + 1 - first));
+            }
+            list = children(node);
+        }
+    }
+
+    // Call fn with every word in the edge list at 'list', each prefixed by 'prefix'
+    template <class F>
+    void forEach(Node const *list, std::string& prefix, F const& fn) const {
+        for (; list && list->getChar() != 0; ++list) {
+            forEachBelow(list, prefix, fn);
+            if (list->isEndOfNode()) {
+                break;
+            }
+        }
+    }
+
+    // Call fn with every word that passes through this node
+    template <class F>
+    void forEachBelow(Node const *node, std::string& prefix, F const& fn) const {
+        prefix.push_back(node->getChar());
+        if (node->isEndOfWord()) {
+            fn(prefix);
+        }
+        forEach(children(node), prefix, fn);
+        prefix.pop_back();
+    }
+
+    // The nodes of the root edge list, one for each initial letter
+    std::vector<Node const *> roots() const {
+        std::vector<Node const *> result;
+        for (auto node = nodes; node != end() && node->getChar() != 0; ++node) {
+            result.push_back(node);
+            if (node->isEndOfNode()) {
+                break;
+            }
+        }
+        return result;
+    }
+
+private:
+    Node const *nodes { nullptr };
+    size_t count { 0 };
+};
+
+typedef BasicView<ZyzzyvaLayout> View;
+
+/* The number of words reachable through each node and its later siblings.  This
+ * gives a minimal perfect hash between the words and their positions in the
+ * lexicon (in the order that dump() produces them) in either direction.
+ */
+struct WordIndex {
+    static constexpr size_t npos = size_t(-1);
+
+    explicit WordIndex(View const& dawg) : dawg(dawg), storage(dawg.size(), uint32_t(unknown)) {
+        for (size_t idx = 0; idx < dawg.size(); ++idx) {
+            compute(idx);
+        }
+        counts = storage.data();
+    }
+    WordIndex(View const& dawg, uint32_t const *counts) : dawg(dawg), counts(counts) {}
+
+    std::vector<uint32_t> const& table() const { return storage; }
+    size_t words() const { return dawg.size() ? counts[0] : 0; }
+
+    // The number of words passing through this node alone
+    size_t below(Node const *node) const {
+        auto idx = dawg.indexOf(node);
+        return counts[idx] - (node->isEndOfNode() ? 0 : counts[idx + 1]);
+    }
+
+    // The position of the first word passing through this node
+    size_t before(Node const *list, Node const *node) const {
+        return counts[dawg.indexOf(list)] - counts[dawg.indexOf(node)];
+    }
+
+    size_t rank(std::string const& word) const {
+        Node const *list = dawg.begin();
+        size_t result = 0;
+        for (size_t i = 0; i < word.size(); ++i) {
+            auto node = View::find(list, word[i]);
+            if (!node) {
+                break;
+            }
+            result += before(list, node);
+            if (i + 1 == word.size()) {
+                return node->isEndOfWord() ? result : npos;
+            }
+            result += node->isEndOfWord();
+            list = dawg.children(node);
+        }
+        return npos;
+    }
+
+    std::string word(size_t rank) const {
+        std::string result;
+        Node const *node = (rank < words()) ? dawg.begin() : nullptr;
+        while (node) {
+            auto count = below(node);
+            if (rank >= count) {
+                rank -= count;
+                node = node->isEndOfNode() ? nullptr : node + 1;
+                continue;
+            }
+            result.push_back(node->getChar());
+            if (node->isEndOfWord() && rank-- == 0) {
+                return result;
+            }
+            node = dawg.children(node);
+        }
+        throw std::out_of_range("word number is outside the lexicon");
+    }
+
+private:
+    static constexpr uint32_t unknown = uint32_t(-1);
+
+    // Fill in the counts for the run of siblings from 'idx' to the end of its edge list
+    uint32_t compute(size_t idx) {
+        if (storage[idx] != unknown) {
+            return storage[idx];
+        }
+        auto last = idx;
+        while (!dawg.at(last).isEndOfNode()) {
+            ++last;
+        }
+        for (auto i = last + 1; i-- > idx; ) {
+            auto const& node = dawg[i];
+            uint32_t count = node.isEndOfWord() + (i == last ? 0 : storage[i + 1]);
+            if (auto next = node.getOffset()) {
+                dawg.at(next - 1);
+                count += compute(next - 1);
+            }
+            storage[i] = count;
+        }
+        return storage[idx];
+    }
+
+    View dawg;
+    std::vector<uint32_t> storage;
+    uint32_t const *counts { nullptr };
+};
+
+// Read the node array from a DAWG file, from its count onwards, checking its size against the count
+template <class Layout = ZyzzyvaLayout>
+std::vector<BasicNode<Layout>> loadNodes(std::istream& is) {
+    auto start = is.tellg();
+    is.seekg(0, is.end);
+    auto size = is.tellg() - start;
+    is.seekg(start);
+
+    uint32_t edges = 0;
+    is.read(reinterpret_cast<char *>(&edges), sizeof(uint32_t));
+    if (Layout::magic == 0 && edges == WideLayout::magic) {
+        throw std::runtime_error("Input is a wide DAWG file, which this command cannot read");
+    }
+    if (uint64_t(edges) * 4 + 4 != uint64_t(size)) {
+        std::cerr << "size is " << size << " and edges is " << edges << "\n";
+        throw std::runtime_error("Input DAWG file appears to be corrupt");
+    }
+    std::vector<BasicNode<Layout>> nodes(edges);
+    is.read(reinterpret_cast<char *>(nodes.data()), edges * sizeof(uint32_t));
+    return nodes;
+}
+
+/* Maps the letters of a lexicon to the dense codes stored in its nodes, so that
+ * lexicons in other languages take no more space than the English one.  Each
+ * line of the definition names one letter, in alphabetical order, followed by
+ * any alternative spellings of it.  A letter may be any UTF-8 character or a
+ * multi-character tile such as CH or L·L.  Codes are numbered from 1, as 0 marks
+ * the end of a list, and text is split into letters by taking the longest
+ * match at each position.
+ */
+struct Alphabet {
+    explicit Alphabet(std::istream& definition) {
+        for (std::string line; std::getline(definition, line); ) {
+            std::istringstream spellings(line);
+            std::string tile;
+            if (!(spellings >> tile) || tile[0] == '#') {
+                continue;
+            }
+            if (names.size() == MAX_CHARS - 1) {
+                throw std::runtime_error("Alphabet has too many letters");
+            }
+            names.push_back(tile);
+            do {
+                if (!codes.emplace(tile, names.size()).second) {
+                    throw std::runtime_error("Letter " + tile + " appears twice in alphabet");
+                }
+                longest = std::max(longest, tile.size());
+                text += tile + " ";
+            } while (spellings >> tile);
+            text.back() = '\n';
+        }
+        if (names.empty()) {
+            throw std::runtime_error("Alphabet is empty");
+        }
+    }
+
+    static Alphabet load(std::string const& path) {
+        std::ifstream definition(path, std::ios::in);
+        if (!definition) {
+            throw std::runtime_error("Unable to open alphabet " + path);
+        }
+        return Alphabet(definition);
+    }
+
+    size_t size() const { return names.size(); }
+
+    // The letters and their spellings, one line each, as the constructor reads them
+    std::string const& definition() const { return text; }
+
+    // The code of the letter at pos, which moves past it, or 0 if there is none
+    unsigned char next(std::string const& text, size_t& pos) const {
+        for (size_t length = std::min(longest, text.size() - pos); length > 0; --length) {
+            auto found = codes.find(text.substr(pos, length));
+            if (found != codes.end()) {
+                pos += length;
+                return found->second;
+            }
+        }
+        return 0;
+    }
+
+    bool encode(std::string const& text, std::string& result) const {
+        result.clear();
+        for (size_t pos = 0; pos < text.size(); ) {
+            if (auto code = next(text, pos)) {
+                result.push_back(code);
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string encode(std::string const& text) const {
+        std::string result;
+        if (!encode(text, result)) {
+            throw std::invalid_argument(text + " contains a letter that is not in the alphabet");
+        }
+        return result;
+    }
+
+    std::string decode(std::string const& letters) const {
+        std::string result;
+        for (unsigned char c : letters) {
+            result += (c == 0 || c > names.size()) ? std::string(1, '?') : names[c - 1];
+        }
+        return result;
+    }
+
+private:
+    std::vector<std::string> names;
+    std::unordered_map<std::string, unsigned char> codes;
+    size_t longest { 0 };
+    std::string text;
+};
+
 struct WordBuffer {
-    WordBuffer(std::istream& input) : input(input) { }
+    WordBuffer(std::istream& input, Alphabet const *alphabet = nullptr) : input(&input), alphabet(alphabet) { }
+
+    // Words already in memory, whose letter codes may include ones that look like spaces
+    explicit WordBuffer(std::vector<std::string> const& words) : words(&words) { }
 
     std::pair<size_t, std::string> next() {
         std::string s;
 
-        while ((input >> s) && s.size() < 2 ) {
+        while (read(s)) {
+            if (alphabet) {
+                s = alphabet->encode(s);
+            }
+            if (s.size() >= 2) {
+                break;
+            }
             ++count;
+            s.clear();
         }
 
+        // Compare as unsigned so that codes and UTF-8 bytes above 127 sort last
         auto search = std::mismatch(s.cbegin(), s.cend(), current.data());
-        if (!s.empty() && (search.first == s.cend() || *search.first < *search.second)) {
+        if (!s.empty() && (search.first == s.cend() ||
+                           static_cast<unsigned char>(*search.first) < static_cast<unsigned char>(*search.second))) {
             throw std::logic_error(std::string("Out of order strings"));
         }
 
+        size_t common = std::distance(s.cbegin(), search.first);
         current = std::move(s);
-        return std::make_pair(std::distance(s.cbegin(), search.first), current);
+        return std::make_pair(common, current);
     }
 
     unsigned char operator[](size_t idx) { return current[idx]; }
 
 private:
+    bool read(std::string& s) {
+        if (words) {
+            return position < words->size() && !(s = (*words)[position++]).empty();
+        }
+        return bool(*input >> s);
+    }
+
     size_t count { 0 };
     std::string current;
-    std::istream& input;
+    std::istream *input { nullptr };
+    std::vector<std::string> const *words { nullptr };
+    size_t position { 0 };
+    Alphabet const *alphabet { nullptr };
 };
 
 
-struct EdgeList {
+/* Restrictions on the words to keep when rebuilding a DAWG: a range of lengths,
+ * letters that must not appear and a prefix that every word must start with.
+ */
+struct WordFilter {
+    size_t min_length { 0 };
+    size_t max_length { size_t(-1) };
+    std::bitset<MAX_CHARS> excluded;
+    std::string prefix;
+
+    // May the letter at this position (from zero) of a word be c?
+    bool allows(unsigned char c, size_t depth) const {
+        return !excluded[c] && depth < max_length && (depth >= prefix.size() || prefix[depth] == char(c));
+    }
+
+    // May a word end after this many letters?
+    bool ends(size_t length) const {
+        return length >= min_length && length <= max_length && length >= prefix.size();
+    }
+
+    // The depth beyond which every position is treated alike
+    size_t horizon() const {
+        return std::max(prefix.size(), max_length != size_t(-1) ? max_length : min_length);
+    }
+};
+
+template <class Layout>
+struct BasicEdgeList {
     size_t hash() const {
-        return std::accumulate(edges.cbegin(), edges.cend(), uint32_t(0), Node::hash_fn) % HASH_TABLE_SIZE;
+        return std::accumulate(edges.cbegin(), edges.cend(), uint32_t(0), BasicNode<Layout>::hash_fn) % Layout::hash_table_size;
     }
 
     template <class T>
@@ -104,34 +661,68 @@ struct EdgeList {
         return std::equal(edges.cbegin(), edges.cend(), start);
     }
 
-    std::vector<Node> edges;
+    std::vector<BasicNode<Layout>> edges;
 };
 
-struct Dawg {
-    Dawg()
-        : dawg(MAX_CHARS) // space for the root nodes which will be filled in later
+template <class Layout>
+struct BasicDawg {
+    typedef BasicNode<Layout> Node;
+    typedef BasicView<Layout> View;
+    typedef BasicEdgeList<Layout> EdgeList;
+
+    // The hash table is only wanted for building, so it is allocated by the first
+    // insertion rather than for DAWGs that are only loaded
+    BasicDawg()
+        : dawg(Layout::root_size) // space for the root nodes which will be filled in later
     {
-        dawg.reserve(HASH_TABLE_SIZE);
-        hash_table.fill(0);
+    }
+
+    View view() const { return View(dawg.data(), dawg.size()); }
+
+    // The alphabet the DAWG was built with, or loaded from its header, if any
+    Alphabet const *alphabet() const { return letters.get(); }
+
+    // Layouts with a magic number are preceded by a header recording the alphabet
+    static bool recognise(std::string const& path) {
+        std::ifstream is(path, std::ios::in | std::ios::binary);
+        uint32_t first = 0;
+        return Layout::magic != 0 && is.read(reinterpret_cast<char *>(&first), sizeof(first)) && first == Layout::magic;
     }
 
     void save(std::ostream&& os) {
+        if (Layout::magic) {
+            if (!letters) {
+                throw std::logic_error("This DAWG format needs an alphabet");
+            }
+            // Pad the alphabet so that the nodes stay aligned when the file is mapped
+            std::string definition { letters->definition() };
+            definition.resize((definition.size() + 3) & ~size_t(3), '\0');
+            output(os, uint32_t(Layout::magic));
+            output(os, uint32_t(header_version));
+            output(os, static_cast<uint32_t>(definition.size()));
+            os.write(definition.data(), definition.size());
+        }
         output(os, static_cast<uint32_t>(dawg.size()));
         for (auto const& node : dawg) {
             node.write(os);
         }
     }
 
-    void dump(std::ostream& os) {
+    void dump(std::ostream& os, Alphabet const *alphabet = nullptr) {
+        if (!alphabet) {
+            alphabet = letters.get();
+        }
         try {
             std::vector<Node const *> stack { 1, &dawg[0] };
+            std::string word;
 
             while (!stack.empty()) {
                 if (stack.back()->isEndOfWord()) {
+                    word.clear();
                     for (auto const& n : stack) {
-                        os << n->getChar();
+                        word.push_back(n->getChar());
                     }
-                    os << "\n";
+                    os << (alphabet ? alphabet->decode(word) : word) << "\n";
                 }
                 if (auto next = stack.back()->getOffset()) {
                     stack.push_back(&dawg.at(next-1)); // at() forces a range check
@@ -149,45 +740,31 @@ struct Dawg {
     }
 
     void load(std::istream&& is) {
-        is.seekg(0, is.end);
-        auto size = is.tellg();
-        is.seekg(0);
-
-        uint32_t edges;
-        is.read(reinterpret_cast<char *>(&edges), sizeof(uint32_t));
-        if (edges * 4 + 4 != size) {
-            std::cerr << "size is " << size << " and edges is " << edges << "\n";
-            throw std::runtime_error("Input DAWG file appears to be corrupt");
+        if (Layout::magic) {
+            letters.reset(new Alphabet(readHeader(is)));
         }
-        dawg.resize(edges);
-        is.read(reinterpret_cast<char *>(dawg.data()), edges * sizeof(uint32_t));
+        dawg = loadNodes<Layout>(is);
     }
 
-    void checksum(std::ostream& os) {
-        static const uint32_t crc_tbl[16] = {
-            0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
-            0x8408, 0x9489, 0xa50a, 0xb58b, 0xc60c, 0xd68d, 0xe70e, 0xf78f,
-        };
-        const unsigned char *p = reinterpret_cast<const unsigned char *>(dawg.data());
-        size_t bytes = dawg.size(); // copy Zyzzyva bug
-        uint32_t crc = 0xffffu;
-
-        while (bytes--) {
-            uint8_t c = *p++;
-            crc = ((crc >> 4) & 0x0fff) ^ crc_tbl[((crc ^ c) & 15)];
-            c >>= 4;
-            crc = ((crc >> 4) & 0x0fff) ^ crc_tbl[((crc ^ c) & 15)];
-        }
+    void load(View const& nodes) {
+        dawg.assign(nodes.begin(), nodes.end());
+    }
 
-        os << ((~crc) & 0xffffu) << "\n";
+    void checksum(std::ostream& os) {
+        os << view().checksum() << "\n";
     }
 
     static const size_t hash_modulo_increment(size_t base, size_t inc) {
         base += inc;
-        return (base >= HASH_TABLE_SIZE) ? base - HASH_TABLE_SIZE : base;
+        return (base >= Layout::hash_table_size) ? base - Layout::hash_table_size : base;
     }
 
     size_t insertEdges(EdgeList const& edges) {
+        if (hash_table.empty()) {
+            hash_table.assign(Layout::hash_table_size, 0);
+            dawg.reserve(Layout::hash_table_size);
+        }
+
         // Search the dawg for a matching array
         const size_t initial_hash = edges.hash();
         size_t hash = initial_hash;
@@ -196,6 +773,9 @@ struct Dawg {
         do {
             if (hash_table[hash] == 0) {
                 // This slot was free - add this set of edges to the DAWG
+                if (dawg.size() + edges.edges.size() > Layout::offset_mask) {
+                    throw std::runtime_error("Too many nodes for the DAWG format");
+                }
                 hash_table[hash] = dawg.size();
                 std::copy(edges.edges.cbegin(), edges.edges.cend(), std::back_inserter(dawg));
                 return hash_table[hash] + 1;
@@ -214,8 +794,25 @@ struct Dawg {
         throw std::logic_error("Hash table full");
     }
 
-    void parse(std::istream& input) {
-        WordBuffer word(input);
+    void parse(std::istream& input, Alphabet const *alphabet = nullptr) {
+        if (alphabet) {
+            if (alphabet->size() >= Layout::root_size) {
+                throw std::invalid_argument("Alphabet has too many letters for the DAWG format");
+            }
+            letters.reset(new Alphabet(*alphabet));
+        }
+        WordBuffer word(input, alphabet);
+        add(word);
+    }
+
+    // Build from words in memory, already in order and in the letters to store
+    void parse(std::vector<std::string> const& words) {
+        WordBuffer word(words);
+        add(word);
+    }
+
+    // Add the words in order, committing each edge list once the words move past it
+    void add(WordBuffer& word) {
         std::vector<EdgeList> edges;
         edges.emplace_back();
         size_t idx = 0; // index of the last entry in 'edges'
@@ -254,63 +851,3823 @@ struct Dawg {
             }
         }
 
+        setRoot(edges.back().edges);
+    }
+
+    /* Rebuild an existing node array bottom up through insertEdges(), so that
+     * every set of identical edge lists is merged and the result is minimal, and
+     * anything that cannot be reached from the root is left behind.  Each edge
+     * list is sorted by letter first, so that lists with the same edges in a
+     * different order are merged too.  Only the words that pass the filter are
+     * kept, so this also derives one lexicon from another without any text.
+     */
+    void rebuild(View const& source, WordFilter const& filter = WordFilter()) {
+        std::unordered_map<uint64_t, uint32_t> offsets;
+        auto root = rebuildList(source, source.begin(), filter, 0, offsets);
+        setRoot(root.edges);
+    }
+
+    /* Optional final pass to store an edge list inside a longer one when it is
+     * identical to the tail of that list.  Readers stop at the end-of-node flag,
+     * so the shorter list can start part way through the longer one.  Lists are
+     * placed longest first, recording every tail of each as it goes, and then all
+     * the offsets are rewritten.  No more edges may be inserted afterwards.
+     */
+    void shareTails() {
+        std::vector<std::pair<size_t, size_t>> lists; // (start, length) of each edge list
+        for (size_t start = Layout::root_size, idx = start; idx < dawg.size(); ++idx) {
+            if (dawg[idx].isEndOfNode()) {
+                lists.emplace_back(start, idx + 1 - start);
+                start = idx + 1;
+            }
+        }
+        std::stable_sort(lists.begin(), lists.end(),
+            [](std::pair<size_t, size_t> const& a, std::pair<size_t, size_t> const& b) { return a.second > b.second; });
+
+        auto key = [&](size_t start, size_t length) {
+            return std::string(reinterpret_cast<char const *>(&dawg[start]), length * sizeof(Node));
+        };
+        std::vector<Node> packed(dawg.begin(), dawg.begin() + Layout::root_size);
+        std::vector<uint32_t> moved(dawg.size() + 1, 0);
+        std::unordered_map<std::string, uint32_t> tails;
+        for (auto const& list : lists) {
+            auto found = tails.find(key(list.first, list.second));
+            if (found != tails.end()) {
+                moved[list.first] = found->second;
+                continue;
+            }
+            moved[list.first] = packed.size();
+            for (size_t i = 0; i < list.second; ++i) {
+                tails.emplace(key(list.first + i, list.second - i), packed.size() + i);
+            }
+            packed.insert(packed.end(), dawg.begin() + list.first, dawg.begin() + list.first + list.second);
+        }
+
+        for (auto& node : packed) {
+            if (auto next = node.getOffset()) {
+                node.clearChildOffset().setChildOffset(moved[next - 1] + 1);
+            }
+        }
+        dawg.swap(packed);
+        std::vector<uint32_t>().swap(hash_table);
+    }
+
+private:
+    static constexpr uint32_t header_version = 1;
+
+    static Alphabet readHeader(std::istream& is) {
+        uint32_t header[3] = { 0, 0, 0 }; // magic, version, alphabet bytes
+        is.read(reinterpret_cast<char *>(header), sizeof(header));
+        if (!is || header[0] != Layout::magic || header[1] != header_version) {
+            throw std::runtime_error("Input DAWG file has an unknown format");
+        }
+        std::string definition(header[2], '\0');
+        if (!is.read(&definition[0], definition.size())) {
+            throw std::runtime_error("Input DAWG file appears to be corrupt");
+        }
+        std::istringstream text(definition.c_str()); // without the padding
+        return Alphabet(text);
+    }
+
+    void setRoot(std::vector<Node>& root) {
         // The final act is to mark the end of the root edge list, expand it to fill the 256
         // entries, mark the end of the root edge list (for compatibility with the file format)
         // and then insert it at the front of the dawg
 
-        auto& root = edges.back().edges;
         if (!root.empty()) {
             root.back().setEndOfNode();
         }
-        root.resize(MAX_CHARS);
+        root.resize(Layout::root_size);
         root.back().setEndOfNode();
         std::copy(root.cbegin(),root.cend(), dawg.begin());
     }
 
-private:
-    std::vector<Node> dawg;
-    std::array<size_t, HASH_TABLE_SIZE> hash_table;
-};
-
-} // namespace Dawg
+    // Copy the source edge list at 'list', whose letters are at position 'depth' in their
+    // words, inserting its children first.  'offsets' maps the source lists already
+    // inserted to their offsets here; the same list may be filtered differently at
+    // different depths, so the depth is part of the key until the filter stops caring.
+    EdgeList rebuildList(View const& source, Node const *list, WordFilter const& filter, size_t depth,
+                         std::unordered_map<uint64_t, uint32_t>& offsets) {
+        static constexpr uint32_t in_progress = uint32_t(-1);
+        std::vector<Node const *> sorted;
+        for (; list && list->getChar() != 0; ++list) {
+            if (filter.allows(list->getChar(), depth)) {
+                sorted.push_back(list);
+            }
+            if (list->isEndOfNode()) {
+                break;
+            }
+        }
+        std::stable_sort(sorted.begin(), sorted.end(),
+            [](Node const *a, Node const *b) { return a->getChar() < b->getChar(); });
 
-int main(int argc, char *argv[])
-{
+        EdgeList result;
+        for (auto edge : sorted) {
+            Node node(edge->getChar(), edge->isEndOfWord() && filter.ends(depth + 1));
+            if (auto child = source.children(edge)) {
+                auto horizon = filter.horizon() + 1;
+                auto key = uint64_t(source.indexOf(child)) * horizon + std::min(depth + 1, horizon - 1);
+                auto found = offsets.emplace(key, in_progress);
+                if (found.second) {
+                    auto edges = rebuildList(source, child, filter, depth + 1, offsets);
+                    if (!edges.edges.empty()) {
+                        edges.edges.back().setEndOfNode();
+                        found.first->second = insertEdges(edges);
+                    }
+                    else {
+                        found.first->second = 0;
+                    }
+                }
+                else if (found.first->second == in_progress) {
+                    throw std::runtime_error("Input DAWG contains a cycle");
+                }
+                node.setChildOffset(found.first->second);
+            }
+            // An edge that neither ends a word nor leads anywhere is dead wood
+            if (node.isEndOfWord() || node.getOffset()) {
+                result.edges.push_back(node);
+            }
+        }
+        return result;
+    }
+
+    std::vector<Node> dawg;
+    std::vector<uint32_t> hash_table;
+    std::unique_ptr<Alphabet> letters;
+};
+
+typedef BasicDawg<ZyzzyvaLayout> Dawg;
+typedef BasicDawg<WideLayout> WideDawg;
+
+/* Statistics about a DAWG file, kept beside it in "<file>.meta" so that they
+ * can be reported without loading or traversing the graph.  The sidecar is a
+ * text file of "key value" lines after a versioned first line.  The file size
+ * and checksum it records are compared with those of the DAWG whenever the DAWG
+ * is loaded, so stale statistics are never reported.
+ */
+struct Metadata {
+    static constexpr unsigned version = 1;
+
+    std::string format;
+    uint64_t words { 0 };
+    uint64_t nodes { 0 };
+    uint64_t bytes { 0 };
+    uint32_t checksum { 0 };            // Zyzzyva's, for reference only
+    uint64_t fingerprint { 0 };         // of every node, to check the DAWG against
+    std::string input_hash;             // FNV-1a of the input the DAWG was built from
+    std::string built;                  // UTC time in ISO 8601 format
+    std::map<size_t, uint64_t> lengths; // the number of words of each length
+
+    static std::string path(std::string const& dawg) { return dawg + ".meta"; }
+
+    // Gather the statistics by traversing the graph
+    template <class Layout>
+    static Metadata describe(BasicView<Layout> const& view, std::string const& format, uint64_t bytes) {
+        Metadata meta;
+        meta.format = format;
+        meta.nodes = view.size();
+        meta.bytes = bytes;
+        meta.checksum = view.checksum();
+        meta.fingerprint = view.fingerprint();
+        std::string prefix;
+        view.forEach(view.begin(), prefix, [&](std::string const& word) {
+            ++meta.words;
+            ++meta.lengths[word.size()];
+        });
+        return meta;
+    }
+
+    static std::string hex(uint64_t value) {
+        char text[17];
+        std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+        return text;
+    }
+
+    /* Passes on what is read from another stream, working out its FNV-1a hash
+     * on the way, so that an input can be hashed while it is parsed rather than
+     * held in memory to hash afterwards.
+     */
+    struct Hasher : std::streambuf {
+        explicit Hasher(std::istream& source) : source(source.rdbuf()) {}
+
+        // The hash of the whole of the source, including anything not yet read
+        std::string hash() {
+            while (sbumpc() != traits_type::eof()) {
+                setg(egptr(), egptr(), egptr());
+            }
+            return hex(value);
+        }
+
+    protected:
+        int_type underflow() {
+            auto got = source ? source->sgetn(buffer, sizeof(buffer)) : 0;
+            if (got <= 0) {
+                return traits_type::eof();
+            }
+            for (std::streamsize idx = 0; idx < got; ++idx) {
+                value = (value ^ static_cast<unsigned char>(buffer[idx])) * 0x100000001b3u;
+            }
+            setg(buffer, buffer, buffer + got);
+            return traits_type::to_int_type(buffer[0]);
+        }
+
+    private:
+        std::streambuf *source;
+        uint64_t value { 0xcbf29ce484222325u };
+        char buffer[65536];
+    };
+
+    static uint64_t fileSize(std::string const& path) {
+        struct stat info;
+        return ::stat(path.c_str(), &info) == 0 ? info.st_size : 0;
+    }
+
+    static std::string now() {
+        auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        struct tm utc;
+        char text[32];
+        std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", ::gmtime_r(&time, &utc));
+        return text;
+    }
+
+    void write(std::ostream& os) const {
+        os << "zyzzyva-dawg-meta " << version << "\n"
+           << "format " << format << "\n"
+           << "words " << words << "\n"
+           << "nodes " << nodes << "\n"
+           << "bytes " << bytes << "\n"
+           << "checksum " << checksum << "\n"
+           << "fingerprint " << hex(fingerprint) << "\n";
+        if (!input_hash.empty()) {
+            os << "input-hash " << input_hash << "\n";
+        }
+        if (!built.empty()) {
+            os << "built " << built << "\n";
+        }
+        os << "lengths";
+        for (auto const& length : lengths) {
+            os << " " << length.first << ":" << length.second;
+        }
+        os << "\n";
+    }
+
+    // Read the sidecar for a DAWG file, returning false if there is none
+    static bool read(std::string const& dawg, Metadata& meta) {
+        std::ifstream is(path(dawg), std::ios::in);
+        std::string line, key;
+        unsigned file_version = 0;
+        if (!is || !std::getline(is, line) || !(std::istringstream(line) >> key >> file_version) ||
+            key != "zyzzyva-dawg-meta") {
+            return false;
+        }
+        if (file_version != version) {
+            throw std::runtime_error(path(dawg) + " has unsupported version " + std::to_string(file_version));
+        }
+        std::map<std::string, std::string> values;
+        while (std::getline(is, line)) {
+            std::istringstream fields(line);
+            if (fields >> key) {
+                std::getline(fields >> std::ws, values[key]);
+            }
+        }
+        auto number = [&](std::string const& key) { return values[key].empty() ? 0 : std::stoull(values[key]); };
+        meta.format = values["format"];
+        meta.words = number("words");
+        meta.nodes = number("nodes");
+        meta.bytes = number("bytes");
+        meta.checksum = number("checksum");
+        meta.fingerprint = values["fingerprint"].empty() ? 0 : std::stoull(values["fingerprint"], nullptr, 16);
+        meta.input_hash = values["input-hash"];
+        meta.built = values["built"];
+        std::istringstream lengths(values["lengths"]);
+        size_t length;
+        uint64_t count;
+        char colon;
+        while (lengths >> length >> colon >> count) {
+            meta.lengths[length] = count;
+        }
+        return true;
+    }
+
+    // Check the sidecar of a DAWG file, if it has one, against the nodes loaded from
+    // it; sidecars written before the fingerprint have only the checksum to go on
+    template <class Layout>
+    static void validate(std::string const& dawg, BasicView<Layout> const& view) {
+        Metadata meta;
+        if (read(dawg, meta) &&
+            (fileSize(dawg) != meta.bytes || view.size() != meta.nodes ||
+             (meta.fingerprint ? view.fingerprint() != meta.fingerprint : view.checksum() != meta.checksum))) {
+            throw std::runtime_error(path(dawg) + " does not match " + dawg + "; remove it or rebuild the DAWG");
+        }
+    }
+};
+
+/* Limits on the work a search may do: how long it may take, how many nodes it
+ * may visit and how many results it may report.  A search that reaches any of
+ * them stops with the results it has found so far and says that it was cut short.
+ */
+struct Limits {
+    std::chrono::steady_clock::duration time { std::chrono::steady_clock::duration::max() };
+    uint64_t nodes { uint64_t(-1) };
+    uint64_t results { uint64_t(-1) };
+};
+
+// What a search has used of its limits, shared between all of its workers
+struct Budget {
+    typedef std::chrono::steady_clock Clock;
+
+    explicit Budget(Limits const& limits) : limits(limits),
+        deadline(limits.time == Clock::duration::max() ? Clock::time_point::max() : Clock::now() + limits.time) {}
+
+    // Take one of the results, or stop the search if they have all been taken
+    bool claim() {
+        if (results.fetch_add(1, std::memory_order_relaxed) < limits.results) {
+            return true;
+        }
+        stopped = true;
+        return false;
+    }
+
+    // Add the nodes a worker has visited since it last checked in, and return how many
+    // more it may visit before checking in again, or 0 if the search must stop
+    uint64_t spend(uint64_t count, unsigned workers) {
+        auto total = nodes.fetch_add(count, std::memory_order_relaxed) + count;
+        if (stopped || total >= limits.nodes || (deadline != Clock::time_point::max() && Clock::now() >= deadline)) {
+            stopped = true;
+            return 0;
+        }
+        return std::min<uint64_t>(256, std::max<uint64_t>(1, (limits.nodes - total) / workers));
+    }
+
+    bool truncated() const { return stopped; }
+
+private:
+    Limits limits;
+    Clock::time_point deadline;
+    std::atomic<uint64_t> nodes { 0 };
+    std::atomic<uint64_t> results { 0 };
+    std::atomic<bool> stopped { false };
+};
+
+// Counts the nodes that one worker visits, checking in with the budget now and then
+struct Meter {
+    Meter(Budget& budget, unsigned workers) : budget(&budget), workers(workers), allowance(budget.spend(0, workers)) {}
+
+    bool visit() {
+        if (used == allowance) {
+            allowance = budget->spend(used, workers);
+            used = 0;
+        }
+        return used++ < allowance;
+    }
+
+    bool claim() { return budget->claim(); }
+
+private:
+    Budget *budget;
+    unsigned workers;
+    uint64_t allowance;
+    uint64_t used { 0 };
+};
+
+/* Companion index for substring and suffix queries, built from the node array
+ * and either kept in memory or written to a file of its own.  Each letter, and
+ * each pair of adjacent letters, maps to the nodes at which it starts, and each
+ * edge list maps back to the nodes that point at it.  A query then visits only
+ * the nodes where the infix occurs, walks backwards from there to the root to
+ * recover the prefixes and forwards to the leaves to recover the completions.
+ * The file's header records the lexicon's node count and fingerprint, as the
+ * alphagram index's does, and everything is 32-bit aligned so that the file can
+ * be used directly from a memory mapping:
+ *
+ *   header, offsets into the parent list for each edge list (+1 at the end),
+ *   offsets into the letter list for each letter (+1), offsets into the pair
+ *   list for each pair of letters (+1), parent list, letter list, pair list
+ */
+struct InfixIndex {
+    static constexpr uint32_t magic = 0x58494457u; // "WDIX"
+    static constexpr uint32_t version = 1;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t lexicon_nodes;
+        uint32_t lexicon_fingerprint[2]; // low and high halves
+        uint32_t parents;
+        uint32_t letters;
+        uint32_t pairs;
+    };
+
+    explicit InfixIndex(View const& dawg) : dawg(dawg) {
+        std::vector<uint32_t> parent_counts(dawg.size() + 1, 0), letter_counts(MAX_CHARS + 1, 0),
+            pair_counts(MAX_CHARS * MAX_CHARS + 1, 0);
+        // Count everything first, so that each table can be a single flat array
+        for (auto const& node : dawg) {
+            if (auto next = node.getOffset()) {
+                dawg.at(next - 1);
+                ++parent_counts[next];
+            }
+            if (node.getChar() != 0) {
+                ++letter_counts[node.getChar() + 1];
+                forEachChild(node, [&](Node const& child) { ++pair_counts[pairKey(node, child) + 1]; });
+            }
+        }
+        std::partial_sum(parent_counts.begin(), parent_counts.end(), parent_counts.begin());
+        std::partial_sum(letter_counts.begin(), letter_counts.end(), letter_counts.begin());
+        std::partial_sum(pair_counts.begin(), pair_counts.end(), pair_counts.begin());
+
+        // Lay the tables out one after another, as they are in a file
+        storage = parent_counts;
+        storage.insert(storage.end(), letter_counts.begin(), letter_counts.end());
+        storage.insert(storage.end(), pair_counts.begin(), pair_counts.end());
+        auto lists = storage.size();
+        storage.resize(lists + parent_counts.back() + letter_counts.back() + pair_counts.back());
+
+        auto parent_fill = parent_counts;
+        auto letter_fill = letter_counts;
+        auto pair_fill = pair_counts;
+        auto parent_list = storage.data() + lists;
+        auto letter_list = parent_list + parent_counts.back();
+        auto pair_list = letter_list + letter_counts.back();
+        for (uint32_t idx = 0; idx < dawg.size(); ++idx) {
+            auto const& node = dawg[idx];
+            if (auto next = node.getOffset()) {
+                parent_list[parent_fill[next - 1]++] = idx;
+            }
+            if (node.getChar() != 0) {
+                letter_list[letter_fill[node.getChar()]++] = idx;
+                forEachChild(node, [&](Node const& child) { pair_list[pair_fill[pairKey(node, child)]++] = idx; });
+            }
+        }
+        locate(storage.data(), parent_counts.back(), letter_counts.back());
+    }
+
+    InfixIndex(View const& lexicon, std::string const& path) : dawg(lexicon), file(new MappedFile(path)) {
+        auto header = reinterpret_cast<Header const *>(file->data());
+        auto body = reinterpret_cast<uint32_t const *>(header + 1);
+        if (file->size() < sizeof(Header) || header->magic != magic || header->version != version ||
+            file->size() != sizeof(Header) + sizeof(uint32_t) * (size_t(header->lexicon_nodes) + 1 + MAX_CHARS + 1 +
+                MAX_CHARS * MAX_CHARS + 1 + size_t(header->parents) + header->letters + header->pairs)) {
+            throw std::runtime_error(path + " is not an infix index");
+        }
+        auto fingerprint = lexicon.fingerprint();
+        if (header->lexicon_nodes != lexicon.size() || header->lexicon_fingerprint[0] != uint32_t(fingerprint) ||
+            header->lexicon_fingerprint[1] != uint32_t(fingerprint >> 32)) {
+            throw std::runtime_error(path + " was built from a different lexicon");
+        }
+        locate(body, header->parents, header->letters);
+        if (parents[lexicon.size()] != header->parents || letters[MAX_CHARS] != header->letters ||
+            pairs[MAX_CHARS * MAX_CHARS] != header->pairs) {
+            throw std::runtime_error(path + " is corrupt");
+        }
+    }
+
+    static void build(View const& lexicon, std::ostream&& os) {
+        InfixIndex index(lexicon);
+        auto fingerprint = lexicon.fingerprint();
+        Header header { magic, version, uint32_t(lexicon.size()), { uint32_t(fingerprint), uint32_t(fingerprint >> 32) },
+            index.parents[lexicon.size()], index.letters[MAX_CHARS], index.pairs[MAX_CHARS * MAX_CHARS] };
+        os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        output(os, index.storage);
+        if (!os) {
+            throw std::runtime_error("Unable to write infix index");
+        }
+    }
+
+    // Call fn with each word containing 'infix' (or ending with it, if 'suffix' is set) in
+    // order, as far as the meter allows; returns false if the meter stopped it, in which
+    // case the words found so far are still given, though not always the first in order
+    template <class F>
+    bool search(std::string const& infix, bool suffix, F const& fn, Meter *meter = nullptr) const {
+        if (infix.empty()) {
+            return true;
+        }
+
+        uint32_t const *first, *last;
+        if (infix.size() == 1) {
+            auto key = static_cast<unsigned char>(infix[0]);
+            first = letter_nodes + letters[key];
+            last = letter_nodes + letters[key + 1];
+        }
+        else {
+            auto key = static_cast<unsigned char>(infix[0]) * MAX_CHARS + static_cast<unsigned char>(infix[1]);
+            first = pair_nodes + pairs[key];
+            last = pair_nodes + pairs[key + 1];
+        }
+
+        // A word containing the infix more than once is found once per occurrence
+        std::set<std::string> words;
+        std::vector<std::string> heads, tails;
+        std::string buffer;
+        bool complete = true;
+        for (; complete && first != last; ++first) {
+            // Match the rest of the infix forwards from this occurrence
+            Node const *node = &dawg[*first];
+            for (auto c = infix.cbegin() + 1; node && c != infix.cend(); ++c) {
+                if (meter && !meter->visit()) {
+                    complete = false;
+                    break;
+                }
+                node = View::find(dawg.children(node), *c);
+            }
+            if (!complete || !node || (suffix && !node->isEndOfWord())) {
+                continue;
+            }
+
+            tails.clear();
+            if (node->isEndOfWord()) {
+                tails.emplace_back();
+            }
+            if (!suffix) {
+                buffer.clear();
+                complete = completions(dawg.children(node), buffer, tails, meter);
+            }
+
+            heads.clear();
+            buffer.clear();
+            complete = prefixes(*first, buffer, heads, meter) && complete;
+            for (auto head = heads.cbegin(); complete && head != heads.cend(); ++head) {
+                for (auto const& tail : tails) {
+                    auto word = *head + infix + tail;
+                    if (words.count(word) == 0) {
+                        if (meter && !meter->claim()) {
+                            complete = false;
+                            break;
+                        }
+                        words.insert(std::move(word));
+                    }
+                }
+            }
+        }
+
+        for (auto const& word : words) {
+            fn(word);
+        }
+        return complete;
+    }
+
+private:
+    static size_t pairKey(Node const& node, Node const& child) {
+        return node.getChar() * MAX_CHARS + child.getChar();
+    }
+
+    template <class F>
+    void forEachChild(Node const& node, F const& fn) const {
+        for (auto child = dawg.children(&node); child; ++child) {
+            fn(*child);
+            if (child->isEndOfNode()) {
+                break;
+            }
+        }
+    }
+
+    // Collect every word below the edge list at 'list', each prefixed by 'word', as far
+    // as the meter allows; returns false if it stopped them
+    bool completions(Node const *list, std::string& word, std::vector<std::string>& out, Meter *meter) const {
+        for (; list && list->getChar() != 0; ++list) {
+            if (meter && !meter->visit()) {
+                return false;
+            }
+            word.push_back(list->getChar());
+            if (list->isEndOfWord()) {
+                out.push_back(word);
+            }
+            bool complete = completions(dawg.children(list), word, out, meter);
+            word.pop_back();
+            if (!complete) {
+                return false;
+            }
+            if (list->isEndOfNode()) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    // Collect every string that leads from the root to the edge containing node 'idx'.
+    // 'reversed' accumulates the letters in reverse as we walk back up the graph.
+    // Returns false if the meter stopped the walk.
+    bool prefixes(uint32_t idx, std::string& reversed, std::vector<std::string>& out, Meter *meter) const {
+        // An edge list may be shared as the tail of a longer one, so every list that
+        // starts at or before this node without an intervening end-of-node leads here
+        for (uint32_t start = idx + 1; start-- > 0; ) {
+            if (start != idx && dawg[start].isEndOfNode()) {
+                break;
+            }
+            if (start == 0) {
+                out.emplace_back(reversed.rbegin(), reversed.rend());
+            }
+            else {
+                for (auto p = parents[start]; p != parents[start + 1]; ++p) {
+                    if (meter && !meter->visit()) {
+                        return false;
+                    }
+                    reversed.push_back(dawg[parent_nodes[p]].getChar());
+                    bool complete = prefixes(parent_nodes[p], reversed, out, meter);
+                    reversed.pop_back();
+                    if (!complete) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Point each table at its place in the body of an index laid out as in a file
+    void locate(uint32_t const *body, size_t parent_count, size_t letter_count) {
+        parents = body;
+        letters = parents + dawg.size() + 1;
+        pairs = letters + MAX_CHARS + 1;
+        parent_nodes = pairs + MAX_CHARS * MAX_CHARS + 1;
+        letter_nodes = parent_nodes + parent_count;
+        pair_nodes = letter_nodes + letter_count;
+    }
+
+    View dawg;
+    std::vector<uint32_t> storage;       // the tables of an index built in memory
+    std::unique_ptr<MappedFile> file;    // or the file they are mapped from
+    uint32_t const *parents { nullptr }; // edge list start -> range in parent_nodes
+    uint32_t const *parent_nodes { nullptr };
+    uint32_t const *letters { nullptr }; // letter -> range in letter_nodes
+    uint32_t const *letter_nodes { nullptr };
+    uint32_t const *pairs { nullptr };   // letter pair -> range in pair_nodes
+    uint32_t const *pair_nodes { nullptr };
+};
+
+/* Index from alphagram (the letters of a word in sorted order) to the words
+ * that are anagrams of it.  The file holds its own DAWG of alphagrams, so an
+ * exact anagram lookup is one walk to find the alphagram's position followed
+ * by a list of word numbers in the lexicon.  The header records the lexicon's
+ * node count and fingerprint, so that an index is never used with a lexicon
+ * other than its own.  Everything is 32-bit aligned so that the file can be
+ * used directly from a memory mapping:
+ *
+ *   header, alphagram nodes, alphagram word counts, lexicon word counts,
+ *   offsets into the word list for each alphagram (+1 at the end), word list
+ */
+struct AlphagramIndex {
+    static constexpr uint32_t magic = 0x49414457u; // "WDAI"
+    static constexpr uint32_t version = 2;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t lexicon_nodes;
+        uint32_t lexicon_fingerprint[2]; // low and high halves
+        uint32_t nodes;
+        uint32_t alphagrams;
+        uint32_t words;
+    };
+
+    static std::string alphagram(std::string word) {
+        std::sort(word.begin(), word.end());
+        return word;
+    }
+
+    static void build(View const& lexicon, std::ostream&& os) {
+        WordIndex lexicon_index(lexicon);
+        auto roots = lexicon.roots();
+
+        // Enumerate each initial letter in parallel, numbering the words as we go
+        std::vector<std::vector<std::pair<std::string, uint32_t>>> found(concurrency());
+        parallelFor(roots.size(), found.size(), [&](unsigned worker, size_t branch) {
+            uint32_t number = lexicon_index.before(lexicon.begin(), roots[branch]);
+            std::string prefix;
+            lexicon.forEachBelow(roots[branch], prefix, [&](std::string const& word) {
+                found[worker].emplace_back(alphagram(word), number++);
+            });
+        });
+        std::vector<std::pair<std::string, uint32_t>> entries;
+        for (auto& part : found) {
+            std::move(part.begin(), part.end(), std::back_inserter(entries));
+            part = {};
+        }
+        parallelSort(entries.begin(), entries.end(),
+            [](std::pair<std::string, uint32_t> const& a, std::pair<std::string, uint32_t> const& b) { return a < b; });
+
+        // Group the words and build a DAWG of the distinct alphagrams
+        std::vector<std::string> alphagrams;
+        std::vector<uint32_t> offsets, words;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i == 0 || entries[i].first != entries[i - 1].first) {
+                alphagrams.push_back(entries[i].first);
+                offsets.push_back(words.size());
+            }
+            words.push_back(entries[i].second);
+        }
+        offsets.push_back(words.size());
+
+        std::unique_ptr<Dawg> dawg(new Dawg);
+        dawg->parse(alphagrams);
+        WordIndex index(dawg->view());
+
+        auto fingerprint = lexicon.fingerprint();
+        Header header { magic, version, uint32_t(lexicon.size()), { uint32_t(fingerprint), uint32_t(fingerprint >> 32) },
+            uint32_t(dawg->view().size()), uint32_t(offsets.size() - 1), uint32_t(words.size()) };
+        os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        for (auto const& node : dawg->view()) {
+            node.write(os);
+        }
+        output(os, index.table());
+        output(os, lexicon_index.table());
+        output(os, offsets);
+        output(os, words);
+        if (!os) {
+            throw std::runtime_error("Unable to write alphagram index");
+        }
+    }
+
+    AlphagramIndex(View const& lexicon, std::string const& path) : file(path) {
+        auto header = reinterpret_cast<Header const *>(file.data());
+        auto body = reinterpret_cast<uint32_t const *>(header + 1);
+        if (file.size() < sizeof(Header) || header->magic != magic || header->version != version ||
+            file.size() != sizeof(Header) + sizeof(uint32_t) *
+                (2 * size_t(header->nodes) + header->lexicon_nodes + header->alphagrams + 1 + header->words)) {
+            throw std::runtime_error(path + " is not an alphagram index");
+        }
+        auto fingerprint = lexicon.fingerprint();
+        if (header->lexicon_nodes != lexicon.size() || header->lexicon_fingerprint[0] != uint32_t(fingerprint) ||
+            header->lexicon_fingerprint[1] != uint32_t(fingerprint >> 32)) {
+            throw std::runtime_error(path + " was built from a different lexicon");
+        }
+        alphagrams = View(reinterpret_cast<Node const *>(body), header->nodes);
+        alphagram_index = WordIndex(alphagrams, body + header->nodes);
+        lexicon_index = WordIndex(lexicon, body + 2 * header->nodes);
+        offsets = body + 2 * header->nodes + header->lexicon_nodes;
+        words = offsets + header->alphagrams + 1;
+    }
+
+    // Call fn with the words that use exactly these letters, in lexicon order, as far
+    // as the meter allows; returns false if the meter stopped them
+    template <class F>
+    bool anagrams(std::string const& letters, F const& fn, Meter *meter = nullptr) const {
+        auto rank = alphagram_index.rank(alphagram(letters));
+        if (rank != WordIndex::npos) {
+            for (auto w = offsets[rank]; w != offsets[rank + 1]; ++w) {
+                if (meter && (!meter->visit() || !meter->claim())) {
+                    return false;
+                }
+                fn(lexicon_index.word(words[w]));
+            }
+        }
+        return true;
+    }
+
+private:
+    MappedFile file;
+    View alphagrams;
+    WordIndex alphagram_index { View() };
+    WordIndex lexicon_index { View() };
+    uint32_t const *offsets { nullptr };
+    uint32_t const *words { nullptr };
+};
+
+/* For each word, the words that differ from it in exactly one letter, for word
+ * ladders and "change one letter" study.  One depth-first walk of the graph
+ * follows pairs of paths with a budget of one changed letter: until the letter
+ * is spent both paths are the same, and at each edge list the walk also tries
+ * every other letter there, after which it only follows the letters the two
+ * paths have in common.  So each prefix, and each prefix with one letter
+ * changed, is walked once for all of the words below it, rather than once for
+ * every word.  The words are numbered in lexicon order, the header records the
+ * lexicon's node count and fingerprint as the alphagram index's does, and
+ * everything is 32-bit aligned so that the file can be used directly from a
+ * memory mapping:
+ *
+ *   header, lexicon word counts, offsets into the neighbour list for each word
+ *   (+1 at the end), neighbour list
+ */
+struct NeighbourIndex {
+    static constexpr uint32_t magic = 0x4e474457u; // "WDGN"
+    static constexpr uint32_t version = 2;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t lexicon_nodes;
+        uint32_t lexicon_fingerprint[2]; // low and high halves
+        uint32_t words;
+        uint32_t neighbours;
+    };
+
+    static void build(View const& lexicon, std::ostream&& os) {
+        WordIndex index(lexicon);
+        auto words = index.words();
+
+        // Each letter of the root edge list starts an independent part of the walk,
+        // so hand them out to the workers, each collecting pairs of word ranks
+        std::vector<Node const *> starts;
+        for (auto node = lexicon.begin(); node && node->getChar() != 0; ++node) {
+            starts.push_back(node);
+            if (node->isEndOfNode()) {
+                break;
+            }
+        }
+        auto workers = concurrency();
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> found(workers);
+        parallelFor(starts.size(), workers, [&](unsigned worker, size_t start) {
+            Pairing { lexicon, index, found[worker] }.from(lexicon.begin(), starts[start]);
+        });
+
+        std::vector<uint32_t> offsets(words + 1, 0), neighbours;
+        for (auto const& pairs : found) {
+            for (auto const& pair : pairs) {
+                ++offsets[pair.first + 1];
+            }
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        neighbours.resize(offsets.back());
+        auto fill = offsets;
+        for (auto const& pairs : found) {
+            for (auto const& pair : pairs) {
+                neighbours[fill[pair.first]++] = pair.second;
+            }
+        }
+        for (size_t rank = 0; rank < words; ++rank) {
+            std::sort(neighbours.begin() + offsets[rank], neighbours.begin() + offsets[rank + 1]);
+        }
+
+        auto fingerprint = lexicon.fingerprint();
+        Header header { magic, version, uint32_t(lexicon.size()), { uint32_t(fingerprint), uint32_t(fingerprint >> 32) },
+            uint32_t(words), uint32_t(neighbours.size()) };
+        os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        output(os, index.table());
+        output(os, offsets);
+        output(os, neighbours);
+        if (!os) {
+            throw std::runtime_error("Unable to write neighbour index");
+        }
+    }
+
+    NeighbourIndex(View const& lexicon, std::string const& path) : file(path) {
+        auto header = reinterpret_cast<Header const *>(file.data());
+        auto body = reinterpret_cast<uint32_t const *>(header + 1);
+        if (file.size() < sizeof(Header) || header->magic != magic || header->version != version ||
+            file.size() != sizeof(Header) + sizeof(uint32_t) *
+                (size_t(header->lexicon_nodes) + header->words + 1 + header->neighbours)) {
+            throw std::runtime_error(path + " is not a neighbour index");
+        }
+        auto fingerprint = lexicon.fingerprint();
+        if (header->lexicon_nodes != lexicon.size() || header->lexicon_fingerprint[0] != uint32_t(fingerprint) ||
+            header->lexicon_fingerprint[1] != uint32_t(fingerprint >> 32)) {
+            throw std::runtime_error(path + " was built from a different lexicon");
+        }
+        index = WordIndex(lexicon, body);
+        offsets = body + header->lexicon_nodes;
+        ranks = offsets + header->words + 1;
+    }
+
+    // Call fn with the words one letter away from this one, in lexicon order, as far as
+    // the meter allows; returns false if the meter stopped them
+    template <class F>
+    bool neighbours(std::string const& word, F const& fn, Meter *meter = nullptr) const {
+        auto rank = index.rank(word);
+        if (rank != WordIndex::npos) {
+            for (auto n = offsets[rank]; n != offsets[rank + 1]; ++n) {
+                if (meter && (!meter->visit() || !meter->claim())) {
+                    return false;
+                }
+                fn(index.word(ranks[n]));
+            }
+        }
+        return true;
+    }
+
+private:
+    /* The walk over pairs of paths, which finds each word and each of its
+     * neighbours together and records their ranks.  Each path has its edge
+     * list and the rank of the first word below that list.
+     */
+    struct Pairing {
+        View const& lexicon;
+        WordIndex const& index;
+        std::vector<std::pair<uint32_t, uint32_t>>& found;
+
+        // Start at one letter of the root edge list, with no letter changed yet
+        void from(Node const *root, Node const *node) {
+            for (auto other = root; other->getChar() != 0; ++other) {
+                step(root, node, 0, root, other, 0, other != node);
+                if (other->isEndOfNode()) {
+                    break;
+                }
+            }
+        }
+
+        // Follow a node on each path, and then every pair of letters below them
+        void step(Node const *list, Node const *node, size_t rank,
+                  Node const *other_list, Node const *other, size_t other_rank, bool changed) {
+            rank += index.before(list, node);
+            other_rank += index.before(other_list, other);
+            if (changed && node->isEndOfWord() && other->isEndOfWord()) {
+                found.emplace_back(uint32_t(rank), uint32_t(other_rank));
+            }
+            auto below = lexicon.children(node);
+            auto other_below = lexicon.children(other);
+            if (!below || !other_below) {
+                return;
+            }
+            rank += node->isEndOfWord();
+            other_rank += other->isEndOfWord();
+            for (auto next = below; next->getChar() != 0; ++next) {
+                if (changed) {
+                    // The letter is spent, so the other path must have this one too
+                    if (auto same = View::find(other_below, next->getChar())) {
+                        step(below, next, rank, other_below, same, other_rank, true);
+                    }
+                }
+                else {
+                    // Still one path, which can keep this letter or change it to any other
+                    for (auto any = below; any->getChar() != 0; ++any) {
+                        step(below, next, rank, below, any, rank, any != next);
+                        if (any->isEndOfNode()) {
+                            break;
+                        }
+                    }
+                }
+                if (next->isEndOfNode()) {
+                    break;
+                }
+            }
+        }
+    };
+
+    MappedFile file;
+    WordIndex index { View() };
+    uint32_t const *offsets { nullptr };
+    uint32_t const *ranks { nullptr };
+};
+
+/* Word probability in the Zyzzyva sense: the number of ways that a word's tiles
+ * can be drawn from a tile bag, with the blanks standing in for any letter.  The
+ * bag is the standard English one unless a distribution is given, one letter
+ * and its number of tiles to a line, with the letters spelled as the alphabet
+ * spells them, if there is one.
+ */
+struct TileBag {
+    // The most tiles of one letter, or blanks, that the table of binomials covers
+    static constexpr unsigned max_tiles = 63;
+
+    explicit TileBag(unsigned blanks = 2) : blanks(checked(blanks, "blanks")) {
+        static const unsigned english[26] = {
+            9, 2, 2, 4, 12, 2, 3, 2, 9, 1, 1, 4, 2, 6, 8, 2, 1, 6, 4, 6, 4, 2, 2, 1, 2, 1,
+        };
+        tiles.fill(0);
+        for (unsigned c = 0; c < 26; ++c) {
+            tiles['A' + c] = tiles['a' + c] = english[c];
+        }
+        tabulate();
+    }
+
+    TileBag(std::istream& distribution, Alphabet const *alphabet, unsigned blanks = 2) : blanks(checked(blanks, "blanks")) {
+        tiles.fill(0);
+        for (std::string line; std::getline(distribution, line); ) {
+            std::istringstream fields(line);
+            std::string letter, codes;
+            unsigned count;
+            if (!(fields >> letter) || letter[0] == '#') {
+                continue;
+            }
+            if (!(fields >> count) || !(alphabet ? alphabet->encode(letter, codes) : (codes = letter, true)) ||
+                codes.size() != 1) {
+                throw std::runtime_error("Expected a letter and its number of tiles but got " + line);
+            }
+            tiles[static_cast<unsigned char>(codes[0])] = checked(count, "tiles of " + letter);
+        }
+        tabulate();
+    }
+
+    uint64_t combinations(std::string const& word) const {
+        std::array<unsigned, MAX_CHARS> wanted;
+        wanted.fill(0);
+        for (unsigned char c : word) {
+            ++wanted[c];
+        }
+
+        // ways[k] is the number of ways to draw the letters so far using k blanks
+        std::vector<uint64_t> ways(blanks + 1, 0), next;
+        ways[0] = 1;
+        for (unsigned c = 0; c < MAX_CHARS; ++c) {
+            if (!wanted[c]) {
+                continue;
+            }
+            next.assign(blanks + 1, 0);
+            for (unsigned used = 0; used <= blanks; ++used) {
+                for (unsigned k = 0; k <= wanted[c] && used + k <= blanks; ++k) {
+                    next[used + k] += ways[used] * choose(tiles[c], wanted[c] - k);
+                }
+            }
+            ways.swap(next);
+        }
+
+        uint64_t total = 0;
+        for (unsigned used = 0; used <= blanks; ++used) {
+            total += ways[used] * choose(blanks, used);
+        }
+        return total;
+    }
+
+private:
+    static unsigned checked(unsigned count, std::string const& what) {
+        if (count > max_tiles) {
+            throw std::invalid_argument("Too many " + what + " (" + std::to_string(count) + "), as the most is " +
+                                        std::to_string(max_tiles));
+        }
+        return count;
+    }
+
+    void tabulate() {
+        for (unsigned n = 0; n < binomial.size(); ++n) {
+            binomial[n].fill(0);
+            binomial[n][0] = 1;
+            for (unsigned k = 1; k <= n; ++k) {
+                binomial[n][k] = binomial[n - 1][k - 1] + binomial[n - 1][k];
+            }
+        }
+    }
+
+    uint64_t choose(unsigned n, unsigned k) const {
+        return (k > n || n >= binomial.size()) ? 0 : binomial[n][k];
+    }
+
+    unsigned blanks;
+    std::array<unsigned, MAX_CHARS> tiles;
+    std::array<std::array<uint64_t, max_tiles + 1>, max_tiles + 1> binomial;
+};
+
+struct Probability {
+    uint64_t combinations;
+    uint32_t number;        // position of the word in the lexicon
+    std::string word;
+    uint32_t rank;          // from 1, shared by words with as many combinations
+
+    bool operator<(Probability const& other) const {
+        return combinations != other.combinations ? combinations > other.combinations : word < other.word;
+    }
+};
+
+// Collect the words of each length (or only 'length', if non-zero) in probability order
+std::vector<std::vector<Probability>> probabilityOrder(View const& dawg, TileBag const& bag, size_t length) {
+    WordIndex index(dawg);
+    auto roots = dawg.roots();
+    std::vector<std::vector<std::vector<Probability>>> found(concurrency());
+
+    parallelFor(roots.size(), found.size(), [&](unsigned worker, size_t branch) {
+        auto& lengths = found[worker];
+        uint32_t number = index.before(dawg.begin(), roots[branch]);
+        std::string word;
+        // Depth-first walk of this initial letter, giving up on anything already too long
+        std::function<void(Node const *)> visit = [&](Node const *node) {
+            word.push_back(node->getChar());
+            if (node->isEndOfWord()) {
+                if (!length || word.size() == length) {
+                    if (lengths.size() <= word.size()) {
+                        lengths.resize(word.size() + 1);
+                    }
+                    lengths[word.size()].push_back(Probability { bag.combinations(word), number, word });
+                }
+                ++number;
+            }
+            if (length && word.size() >= length) {
+                number += index.below(node) - node->isEndOfWord();
+            }
+            else {
+                for (auto child = dawg.children(node); child; ++child) {
+                    visit(child);
+                    if (child->isEndOfNode()) {
+                        break;
+                    }
+                }
+            }
+            word.pop_back();
+        };
+        visit(roots[branch]);
+    });
+
+    std::vector<std::vector<Probability>> result;
+    for (auto& lengths : found) {
+        if (result.size() < lengths.size()) {
+            result.resize(lengths.size());
+        }
+        for (size_t n = 0; n < lengths.size(); ++n) {
+            std::move(lengths[n].begin(), lengths[n].end(), std::back_inserter(result[n]));
+        }
+    }
+    for (auto& words : result) {
+        parallelSort(words.begin(), words.end(), std::less<Probability>());
+        for (size_t n = 0; n < words.size(); ++n) {
+            bool tied = n > 0 && words[n].combinations == words[n - 1].combinations;
+            words[n].rank = tied ? words[n - 1].rank : n + 1;
+        }
+    }
+    return result;
+}
+
+/* A set of lexicons published in a named POSIX shared memory segment, so that
+ * any number of processes on the host can attach to them by name and share a
+ * single copy of each node array, or packed into an archive file that is mapped
+ * once however many of its lexicons are opened.  Both hold a header, a table of
+ * entries giving each lexicon's name, fingerprint and the location of its node
+ * array, and then the node arrays themselves, each starting on a page boundary.
+ * Publishing again replaces the segment; processes attached to the old one keep
+ * it until they detach.  The magic number is written last, so a process that
+ * attaches while a segment is being filled in is told so rather than reading a
+ * partial table.
+ */
+struct Registry {
+    static constexpr uint32_t magic = 0x52474457u; // "WDGR"
+    static constexpr uint32_t version = 3;
+    static constexpr uint64_t alignment = 4096;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entries;
+        uint32_t reserved;
+    };
+
+    struct Entry {
+        char name[48];
+        uint64_t offset;    // bytes from the start of the segment
+        uint32_t nodes;
+        uint32_t fingerprint[2]; // low and high halves
+        uint32_t reserved;
+    };
+
+    static void publish(std::string const& segment, std::vector<std::pair<std::string, View>> const& lexicons) {
+        uint64_t size = 0;
+        auto entries = layout(lexicons, size);
+
+        ::shm_unlink(segment.c_str());
+        int fd = ::shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        void *address = MAP_FAILED;
+        if (fd >= 0 && ::ftruncate(fd, size) == 0) {
+            address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (address == MAP_FAILED) {
+            ::shm_unlink(segment.c_str());
+            throw std::runtime_error("Unable to create shared memory segment " + segment + ": " + std::strerror(errno));
+        }
+
+        // Anyone attaching while the segment is filled in sees no magic number until it is complete
+        write(static_cast<char *>(address), entries, lexicons, false);
+        std::atomic_thread_fence(std::memory_order_release);
+        static_cast<Header volatile *>(address)->magic = magic;
+        ::munmap(address, size);
+    }
+
+    static void unpublish(std::string const& segment) {
+        if (::shm_unlink(segment.c_str()) != 0) {
+            throw std::runtime_error("Unable to remove shared memory segment " + segment + ": " + std::strerror(errno));
+        }
+    }
+
+    static void pack(std::string const& path, std::vector<std::pair<std::string, View>> const& lexicons) {
+        uint64_t size = 0;
+        auto entries = layout(lexicons, size);
+        std::vector<char> image(size, 0);
+        write(image.data(), entries, lexicons);
+
+        std::ofstream os(path, std::ios::out | std::ios::binary);
+        if (!os.write(image.data(), image.size())) {
+            throw std::runtime_error("Unable to write archive " + path);
+        }
+    }
+
+    // The archive at 'path', shared with any other lexicons already opened from the same file
+    static std::shared_ptr<Registry const> archive(std::string const& path) {
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0) {
+            throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+        }
+        // A replaced archive is a different file, so identify it by more than its name
+        std::ostringstream key;
+        key << path << ":" << info.st_ino << ":" << info.st_size << ":" << info.st_mtim.tv_sec << "." << info.st_mtim.tv_nsec;
+
+        static std::mutex lock;
+        static std::map<std::string, std::weak_ptr<Registry const>> open;
+        std::lock_guard<std::mutex> guard(lock);
+        // Forget archives that nothing uses any more, including those since replaced
+        for (auto entry = open.begin(); entry != open.end(); ) {
+            if (entry->second.expired()) {
+                entry = open.erase(entry);
+            }
+            else {
+                ++entry;
+            }
+        }
+        auto& entry = open[key.str()];
+        auto shared = entry.lock();
+        if (!shared) {
+            shared = std::make_shared<Registry const>(path, true);
+            entry = shared;
+        }
+        return shared;
+    }
+
+    explicit Registry(std::string const& source, bool archive = false) : source(source), memory(source, !archive) {
+        auto header = reinterpret_cast<Header const *>(memory.data());
+        if (!archive && memory.size() >= sizeof(Header) && static_cast<Header const volatile *>(header)->magic == 0) {
+            throw std::runtime_error(source + " is still being published");
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (memory.size() < sizeof(Header) || header->magic != magic || header->version != version ||
+            memory.size() < sizeof(Header) + header->entries * sizeof(Entry)) {
+            throw std::runtime_error(source + (archive ? " is not a lexicon archive" : " is not a lexicon registry"));
+        }
+        auto entries = reinterpret_cast<Entry const *>(header + 1);
+        for (uint32_t i = 0; i < header->entries; ++i) {
+            if (entries[i].offset + uint64_t(entries[i].nodes) * sizeof(Node) > memory.size()) {
+                throw std::runtime_error(source + " is corrupt");
+            }
+            View view(reinterpret_cast<Node const *>(memory.data() + entries[i].offset), entries[i].nodes);
+            std::string name(entries[i].name, strnlen(entries[i].name, sizeof(entries[i].name)));
+            auto fingerprint = view.fingerprint();
+            if (entries[i].fingerprint[0] != uint32_t(fingerprint) || entries[i].fingerprint[1] != uint32_t(fingerprint >> 32)) {
+                throw std::runtime_error("Lexicon " + name + " in " + source + " does not match its fingerprint");
+            }
+            views.emplace_back(name, view);
+        }
+    }
+
+    std::vector<std::pair<std::string, View>> const& lexicons() const { return views; }
+
+    View view(std::string const& name) const {
+        for (auto const& entry : views) {
+            if (entry.first == name) {
+                return entry.second;
+            }
+        }
+        throw std::runtime_error("No lexicon " + name + " in " + source);
+    }
+
+private:
+    static std::vector<Entry> layout(std::vector<std::pair<std::string, View>> const& lexicons, uint64_t& size) {
+        std::vector<Entry> entries(lexicons.size());
+        size = sizeof(Header) + entries.size() * sizeof(Entry);
+        for (size_t i = 0; i < lexicons.size(); ++i) {
+            if (lexicons[i].first.size() >= sizeof(entries[i].name)) {
+                throw std::invalid_argument("Lexicon name is too long: " + lexicons[i].first);
+            }
+            std::memset(&entries[i], 0, sizeof(Entry));
+            lexicons[i].first.copy(entries[i].name, sizeof(entries[i].name) - 1);
+            size = (size + alignment - 1) & ~(alignment - 1);
+            entries[i].offset = size;
+            entries[i].nodes = lexicons[i].second.size();
+            auto fingerprint = lexicons[i].second.fingerprint();
+            entries[i].fingerprint[0] = uint32_t(fingerprint);
+            entries[i].fingerprint[1] = uint32_t(fingerprint >> 32);
+            size += entries[i].nodes * sizeof(Node);
+        }
+        return entries;
+    }
+
+    static void write(char *base, std::vector<Entry> const& entries, std::vector<std::pair<std::string, View>> const& lexicons,
+                      bool ready = true) {
+        Header header { ready ? magic : 0, version, uint32_t(entries.size()), 0 };
+        std::memcpy(base, &header, sizeof(header));
+        std::memcpy(base + sizeof(header), entries.data(), entries.size() * sizeof(Entry));
+        for (size_t i = 0; i < lexicons.size(); ++i) {
+            std::copy(lexicons[i].second.begin(), lexicons[i].second.end(), reinterpret_cast<Node *>(base + entries[i].offset));
+        }
+    }
+
+    std::string source;
+    MappedFile memory;
+    std::vector<std::pair<std::string, View>> views;
+};
+
+/* A lexicon opened for querying.  It is named either by a DAWG file, which is
+ * loaded into memory (or mapped, if requested), by "shm:<segment>:<name>" to
+ * attach to a lexicon that has been published in shared memory, or by
+ * "pack:<archive>:<name>" for one in an archive file; those two are used in
+ * place.  A node array that already exists in memory can be wrapped too.
+ */
+struct Lexicon {
+    explicit Lexicon(View const& nodes) : dawg(nodes) {}
+    explicit Lexicon(std::string const& spec, bool mapped = false) {
+        if (spec.compare(0, 4, "shm:") == 0) {
+            auto colon = spec.find(':', 4);
+            if (colon == std::string::npos) {
+                throw std::invalid_argument("Expected shm:<segment>:<name> but got " + spec);
+            }
+            registry = std::make_shared<Registry>(spec.substr(4, colon - 4));
+            dawg = registry->view(spec.substr(colon + 1));
+        }
+        else if (spec.compare(0, 5, "pack:") == 0) {
+            auto colon = spec.rfind(':');
+            if (colon < 5) {
+                throw std::invalid_argument("Expected pack:<archive>:<name> but got " + spec);
+            }
+            registry = Registry::archive(spec.substr(5, colon - 5));
+            dawg = registry->view(spec.substr(colon + 1));
+        }
+        else if (mapped) {
+            file.reset(new MappedFile(spec));
+            auto edges = reinterpret_cast<uint32_t const *>(file->data());
+            if (file->size() < sizeof(uint32_t) || uint64_t(edges[0]) * 4 + 4 != file->size()) {
+                throw std::runtime_error("Input DAWG file appears to be corrupt");
+            }
+            dawg = View(reinterpret_cast<Node const *>(edges + 1), edges[0]);
+            Metadata::validate(spec, dawg);
+        }
+        else {
+            std::ifstream is(spec, std::ios::in | std::ios::binary);
+            nodes = loadNodes(is);
+            dawg = View(nodes.data(), nodes.size());
+            Metadata::validate(spec, dawg);
+        }
+    }
+    Lexicon(Lexicon const&) = delete;
+    Lexicon& operator=(Lexicon const&) = delete;
+
+    View const& view() const { return dawg; }
+
+    // The fingerprint of the node array, worked out the first time it is wanted
+    uint64_t fingerprint() const {
+        std::call_once(fingerprinted, [this] { hash = dawg.fingerprint(); });
+        return hash;
+    }
+
+    // The file a lexicon is read from, or nothing if it is in shared memory
+    static std::string source(std::string const& spec) {
+        if (spec.compare(0, 4, "shm:") == 0) {
+            return "";
+        }
+        if (spec.compare(0, 5, "pack:") == 0) {
+            return spec.substr(5, spec.rfind(':') - 5);
+        }
+        return spec;
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::unique_ptr<MappedFile> file;
+    std::shared_ptr<Registry const> registry;
+    View dawg;
+    mutable std::once_flag fingerprinted;
+    mutable uint64_t hash { 0 };
+};
+
+/* A word pattern: '?' matches any one letter, '*' any run of letters (including
+ * none) and [ABC] any one of the listed letters.  Matching tracks the set of
+ * pattern positions reachable so far, so a search can abandon a subtree as soon
+ * as that set becomes empty.
+ */
+struct Pattern {
+    typedef uint64_t States;
+
+    explicit Pattern(std::string const& text, Alphabet const *alphabet = nullptr) {
+        for (size_t i = 0; i < text.size(); ) {
+            tokens.emplace_back();
+            auto& token = tokens.back();
+            if (text[i] == '*' || text[i] == '?') {
+                token.star = text[i++] == '*';
+                token.letters.set();
+                token.letters.reset(0);
+            }
+            else if (text[i] == '[') {
+                auto close = text.find(']', i);
+                if (close == std::string::npos) {
+                    throw std::invalid_argument("Unterminated [ in pattern " + text);
+                }
+                for (++i; i < close; ) {
+                    token.letters.set(letter(text, i, alphabet));
+                }
+                ++i;
+            }
+            else {
+                token.letters.set(letter(text, i, alphabet));
+            }
+        }
+        if (tokens.size() >= 64) {
+            throw std::invalid_argument("Pattern is too long: " + text);
+        }
+    }
+
+    States start() const { return closure(1); }
+    bool accepts(States states) const { return (states >> tokens.size()) & 1; }
+
+    States step(States states, unsigned char c) const {
+        States next = 0;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (((states >> i) & 1) && tokens[i].letters[c]) {
+                next |= States(1) << (tokens[i].star ? i : i + 1);
+            }
+        }
+        return closure(next);
+    }
+
+private:
+    // The letter at pos, which moves past it
+    static unsigned char letter(std::string const& text, size_t& pos, Alphabet const *alphabet) {
+        if (!alphabet) {
+            return text[pos++];
+        }
+        if (auto code = alphabet->next(text, pos)) {
+            return code;
+        }
+        throw std::invalid_argument("Pattern " + text + " contains a letter that is not in the alphabet");
+    }
+
+    // A '*' can match nothing, so reaching it also reaches the position after it
+    States closure(States states) const {
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            if (((states >> i) & 1) && tokens[i].star) {
+                states |= States(1) << (i + 1);
+            }
+        }
+        return states;
+    }
+
+    struct Token {
+        bool star { false };
+        std::bitset<MAX_CHARS> letters;
+    };
+    std::vector<Token> tokens;
+};
+
+/* Count a rack of tiles by letter, where '?' is a blank.  Letter codes start at
+ * 1, so the count of blanks goes in counts[0].  Returns the number of tiles.
+ */
+size_t countTiles(std::string const& letters, Alphabet const *alphabet, std::array<unsigned, MAX_CHARS>& counts) {
+    counts.fill(0);
+    size_t tiles = 0;
+    for (size_t pos = 0; pos < letters.size(); ++tiles) {
+        if (letters[pos] == '?') {
+            ++counts[0];
+            ++pos;
+        }
+        else if (!alphabet) {
+            ++counts[static_cast<unsigned char>(letters[pos++])];
+        }
+        else if (auto code = alphabet->next(letters, pos)) {
+            ++counts[code];
+        }
+        else {
+            throw std::invalid_argument(letters + " contains a letter that is not in the alphabet");
+        }
+    }
+    return tiles;
+}
+
+/* Walking the graph depth first under the control of a walker, which follows a
+ * search along the current path:
+ *
+ *   bool enter(Node const *node)   move down through the node, or return false to skip its subtree
+ *   bool accepts() const           whether the word just entered is a result, if it is a word at all
+ *   void leave()                   move back up
+ *   std::string const& word()      the letters of the current path
+ *
+ * A walker must be copyable, so that a walk can be split: whenever the splitter
+ * wants more work, the rest of the edge list being walked is handed to it along
+ * with a copy of the walker as it stands above that list.
+ */
+struct NoSplit {
+    bool wanted() const { return false; }
+
+    template <class Node, class Walker>
+    void operator()(Node const *, Node const *, Walker const&) const {}
+};
+
+// Walk the nodes of an edge list from 'list' up to (but not including) 'stop',
+// or to the end of the list if stop is null, calling fn with each result.
+// Returns false if the walk was stopped by its limits.
+template <class Layout, class Walker, class F, class Split = NoSplit>
+bool walk(BasicView<Layout> const& dawg, typename BasicView<Layout>::Node const *list,
+          typename BasicView<Layout>::Node const *stop, Walker& walker, F const& fn, Meter& meter,
+          Split const& split = Split()) {
+    for (auto node = list; node && node != stop && node->getChar() != 0; ++node) {
+        if (!node->isEndOfNode() && node + 1 != stop && (node + 1)->getChar() != 0 && split.wanted()) {
+            split(node + 1, stop, walker);
+            stop = node + 1;
+        }
+        if (!meter.visit()) {
+            return false;
+        }
+        if (walker.enter(node)) {
+            if (node->isEndOfWord() && walker.accepts()) {
+                if (!meter.claim()) {
+                    return false;
+                }
+                fn(walker.word());
+            }
+            bool more = walk(dawg, dawg.children(node), nullptr, walker, fn, meter, split);
+            walker.leave();
+            if (!more) {
+                return false;
+            }
+        }
+        if (node->isEndOfNode()) {
+            break;
+        }
+    }
+    return true;
+}
+
+/* Runs a walk on a pool of workers.  It starts as one task for each branch of the
+ * first edge list, dealt out between the workers' queues.  Each worker takes
+ * tasks from the back of its own queue, so that it keeps working on the part of
+ * the graph it has just been in, and when that is empty steals from the front
+ * of another's, where the largest untouched subtrees are.  While any worker is
+ * idle, the others give away the rest of whichever edge list they are walking,
+ * so the deeper lists are only split when there is someone to take them.
+ *
+ * The results are gathered by each worker and returned together, sorted back
+ * into lexicon order if wanted.  If the search is stopped by its limits, they
+ * are whichever results the workers had found by then.
+ */
+template <class Layout, class Walker>
+struct ParallelWalk {
+    typedef BasicNode<Layout> Node;
+
+    ParallelWalk(BasicView<Layout> const& dawg, unsigned workers, Budget& budget)
+        : dawg(dawg), queues(workers), results(workers), budget(budget) {}
+
+    std::vector<std::string> run(Node const *list, Walker const& start, bool ordered) {
+        size_t branch = 0;
+        for (auto node = list; node && node->getChar() != 0; ++node) {
+            push(branch++ % queues.size(), std::unique_ptr<Task>(new Task { node, node + 1, start }));
+            if (node->isEndOfNode()) {
+                break;
+            }
+        }
+        std::vector<std::thread> threads;
+        try {
+            for (unsigned id = 1; id < queues.size(); ++id) {
+                threads.emplace_back(&ParallelWalk::work, this, id);
+            }
+        }
+        catch (...) {
+            fail();
+        }
+        work(0);
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (failure) {
+            std::rethrow_exception(failure);
+        }
+
+        std::vector<std::string> words;
+        for (auto& found : results) {
+            std::move(found.begin(), found.end(), std::back_inserter(words));
+        }
+        if (ordered) {
+            parallelSort(words.begin(), words.end(), std::less<std::string>());
+        }
+        return words;
+    }
+
+private:
+    struct Task {
+        Node const *first;
+        Node const *stop;
+        Walker walker;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::unique_ptr<Task>> tasks;
+    };
+
+    // Hands the rest of an edge list to the pool while any worker is idle
+    struct Split {
+        ParallelWalk *pool;
+        unsigned worker;
+
+        bool wanted() const { return pool->idle.load(std::memory_order_relaxed) != 0; }
+
+        void operator()(Node const *first, Node const *stop, Walker const& walker) const {
+            pool->push(worker, std::unique_ptr<Task>(new Task { first, stop, walker }));
+        }
+    };
+
+    void push(unsigned worker, std::unique_ptr<Task> task) {
+        ++pending;
+        ++queued;
+        {
+            std::lock_guard<std::mutex> hold(queues[worker].lock);
+            queues[worker].tasks.push_back(std::move(task));
+        }
+        signal(false);
+    }
+
+    // Wake one idle worker, or all of them, after a change to what they wait for;
+    // taking the lock orders the change before any waiter's check
+    void signal(bool all) {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+        }
+        if (all) {
+            wake.notify_all();
+        }
+        else {
+            wake.notify_one();
+        }
+    }
+
+    // Stop every worker, keeping the first exception to rethrow from run()
+    void fail() {
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+            stopped = true;
+        }
+        wake.notify_all();
+    }
+
+    bool finished() const { return stopped || pending == 0 || budget.truncated(); }
+
+    std::unique_ptr<Task> pop(unsigned worker) {
+        for (unsigned i = 0; i < queues.size(); ++i) {
+            auto& queue = queues[(worker + i) % queues.size()];
+            std::lock_guard<std::mutex> hold(queue.lock);
+            if (!queue.tasks.empty()) {
+                std::unique_ptr<Task> task;
+                if (i == 0) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                }
+                else {
+                    task = std::move(queue.tasks.front());
+                    queue.tasks.pop_front();
+                }
+                --queued;
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    void work(unsigned worker) {
+        auto& found = results[worker];
+        auto report = [&found](std::string const& word) { found.push_back(word); };
+        Meter meter(budget, queues.size());
+        try {
+            while (!stopped && !budget.truncated()) {
+                if (auto task = pop(worker)) {
+                    walk(dawg, task->first, task->stop, task->walker, report, meter, Split { this, worker });
+                    if (--pending == 0 || budget.truncated()) {
+                        signal(true);
+                    }
+                }
+                else {
+                    // Sleep until there is a task to steal or nothing more to do
+                    std::unique_lock<std::mutex> hold(lock);
+                    ++idle;
+                    wake.wait(hold, [this] { return queued != 0 || finished(); });
+                    --idle;
+                    if (queued == 0) {
+                        break;
+                    }
+                }
+            }
+        }
+        catch (...) {
+            fail();
+        }
+    }
+
+    BasicView<Layout> dawg;
+    std::vector<Queue> queues;
+    std::vector<std::vector<std::string>> results;
+    Budget& budget;
+    std::atomic<size_t> pending { 0 }; // tasks queued or running
+    std::atomic<size_t> queued { 0 };  // tasks queued
+    std::atomic<unsigned> idle { 0 };  // workers waiting for a task
+    std::atomic<bool> stopped { false };
+    std::exception_ptr failure;        // the first exception thrown by a worker
+    std::mutex lock;                   // guards failure, and the waits on wake
+    std::condition_variable wake;
+};
+
+// Walk from an edge list on one thread or several, calling fn with each result
+// that the budget allows
+template <class Layout, class Walker, class F>
+void execute(BasicView<Layout> const& dawg, typename BasicView<Layout>::Node const *list, Walker& walker, F const& fn,
+             unsigned workers, bool ordered, Budget& budget) {
+    if (workers > 1) {
+        for (auto const& word : ParallelWalk<Layout, Walker>(dawg, workers, budget).run(list, walker, ordered)) {
+            fn(word);
+        }
+    }
+    else {
+        Meter meter(budget, 1);
+        walk(dawg, list, nullptr, walker, fn, meter);
+    }
+}
+
+// The words beginning with a prefix, some or all of which may already be on the path
+struct Prefixed {
+    explicit Prefixed(std::string const& prefix = std::string()) : prefix(prefix) {}
+
+    template <class Node>
+    bool enter(Node const *node) {
+        auto depth = path.size();
+        if (depth < prefix.size() && node->getChar() != static_cast<unsigned char>(prefix[depth])) {
+            return false;
+        }
+        path.push_back(node->getChar());
+        return true;
+    }
+    bool accepts() const { return path.size() >= prefix.size(); }
+    void leave() { path.pop_back(); }
+    std::string const& word() const { return path; }
+
+    std::string prefix;
+    std::string path;
+};
+
+// The words matching a pattern, with the pattern's states at each depth
+struct Matching {
+    explicit Matching(Pattern const& compiled) : compiled(&compiled), states(1, compiled.start()) {}
+
+    template <class Node>
+    bool enter(Node const *node) {
+        auto next = compiled->step(states.back(), node->getChar());
+        if (!next) {
+            return false;
+        }
+        path.push_back(node->getChar());
+        states.push_back(next);
+        return true;
+    }
+    bool accepts() const { return compiled->accepts(states.back()); }
+    void leave() {
+        path.pop_back();
+        states.pop_back();
+    }
+    std::string const& word() const { return path; }
+
+    Pattern const *compiled;
+    std::vector<Pattern::States> states;
+    std::string path;
+};
+
+// The words using all of the remaining tiles, with the tile used at each depth
+struct UsingLetters {
+    template <class Node>
+    bool enter(Node const *node) {
+        // Use the letter itself if we have it, otherwise a blank
+        auto c = node->getChar();
+        auto tile = counts[c] ? c : 0;
+        if (!remaining || !counts[tile]) {
+            return false;
+        }
+        --counts[tile];
+        --remaining;
+        used.push_back(tile);
+        path.push_back(c);
+        return true;
+    }
+    bool accepts() const { return remaining == 0; }
+    void leave() {
+        ++counts[static_cast<unsigned char>(used.back())];
+        ++remaining;
+        used.pop_back();
+        path.pop_back();
+    }
+    std::string const& word() const { return path; }
+
+    std::array<unsigned, MAX_CHARS> counts;
+    size_t remaining;
+    std::string used;
+    std::string path;
+};
+
+/* The results of a walk produced one at a time, keeping the walk on an explicit
+ * stack of the nodes entered for each letter of the current word, so that it
+ * can stop after any result, or part way between results when its limits run
+ * out, and carry on later.  Its position can be written out as a cursor:
+ *
+ *   <lexicon>.<path>.<next>
+ *
+ * where the lexicon is 8 hex digits of the fingerprint of the lexicon that it
+ * walks, the path has 4 hex digits for each node on the stack (its position
+ * in its edge list and its letter) and next is the position of the next node
+ * to try in the list below them, or nothing if the walk goes back up.  It is
+ * resumed by entering the same nodes again, checking each letter, without
+ * searching any other part of the graph.  A cursor for another lexicon, or
+ * for the same one after it has been rebuilt, is rejected.
+ */
+template <class Layout, class Walker>
+struct BasicEnumeration {
+    typedef BasicNode<Layout> Node;
+    typedef BasicView<Layout> View;
+
+    BasicEnumeration() = default;
+    BasicEnumeration(View const& dawg, Walker const& walker, uint32_t lexicon = 0)
+        : dawg(dawg), walker(walker), lexicon(lexicon), pending(dawg.begin()) {}
+
+    // Move on to the next result, returning false when there are no more or, if
+    // there is a meter, when it stops the walk
+    bool next(Meter *meter = nullptr) {
+        for (auto node = pending; ; ) {
+            if (node && node->getChar() != 0) {
+                if (meter && !meter->visit()) {
+                    pending = node;
+                    return false;
+                }
+                if (!walker.enter(node)) {
+                    node = node->isEndOfNode() ? nullptr : node + 1;
+                    continue;
+                }
+                if (node->isEndOfWord() && walker.accepts()) {
+                    if (meter && !meter->claim()) {
+                        walker.leave();
+                        pending = node;
+                        return false;
+                    }
+                    stack.push_back(node);
+                    pending = dawg.children(node);
+                    return true;
+                }
+                stack.push_back(node);
+                node = dawg.children(node);
+            }
+            else if (stack.empty()) {
+                pending = nullptr;
+                return false;
+            }
+            else {
+                node = stack.back();
+                stack.pop_back();
+                walker.leave();
+                node = node->isEndOfNode() ? nullptr : node + 1;
+            }
+        }
+    }
+
+    // The current result
+    std::string const& word() const { return walker.word(); }
+
+    // Whether two enumerations of the same walk are at the same result
+    bool operator==(BasicEnumeration const& other) const { return stack == other.stack && pending == other.pending; }
+
+    // The position from which the walk carries on
+    std::string cursor() const {
+        std::string result = hex(lexicon, 8) + ".";
+        for (size_t depth = 0; depth < stack.size(); ++depth) {
+            result += hex(stack[depth] - list(depth), 2) + hex(stack[depth]->getChar(), 2);
+        }
+        result += ".";
+        if (pending && pending->getChar() != 0) {
+            result += hex(pending - list(stack.size()), 2);
+        }
+        return result;
+    }
+
+    // Carry on from a position given by cursor(), or from the start if it is empty
+    void resume(std::string const& position) {
+        rewind();
+        if (position.empty()) {
+            return;
+        }
+        auto first = position.find('.');
+        auto second = position.find('.', first + 1);
+        if (first != 8 || second == std::string::npos || (second - first - 1) % 4 != 0 ||
+            (position.size() != second + 1 && position.size() != second + 3) || position.find('.', second + 1) != std::string::npos ||
+            position.find_first_not_of("0123456789abcdef.") != std::string::npos) {
+            throw std::invalid_argument("Invalid cursor (" + position + ")");
+        }
+        if (std::stoul(position.substr(0, 8), nullptr, 16) != lexicon) {
+            throw std::invalid_argument("Cursor is for a different lexicon, or one since rebuilt");
+        }
+        for (size_t i = first + 1; i < second; i += 4) {
+            auto node = at(list(stack.size()), std::stoul(position.substr(i, 2), nullptr, 16));
+            if (!node || node->getChar() != std::stoul(position.substr(i + 2, 2), nullptr, 16) || !walker.enter(node)) {
+                throw std::invalid_argument("Cursor does not match the lexicon or the search");
+            }
+            stack.push_back(node);
+        }
+        pending = nullptr;
+        if (position.size() == second + 3) {
+            pending = at(list(stack.size()), std::stoul(position.substr(second + 1, 2), nullptr, 16));
+            if (!pending) {
+                throw std::invalid_argument("Cursor does not match the lexicon or the search");
+            }
+        }
+    }
+
+    // Carry on from a word, so that the next result is the first at or after it in lexicon order
+    void seek(std::string const& word) {
+        rewind();
+        for (size_t depth = 0; depth < word.size(); ++depth) {
+            auto c = static_cast<unsigned char>(word[depth]);
+            auto node = list(depth);
+            while (node && node->getChar() != 0 && node->getChar() < c) {
+                node = node->isEndOfNode() ? nullptr : node + 1;
+            }
+            if (!node || node->getChar() != c || depth + 1 == word.size()) {
+                pending = node;
+                return;
+            }
+            if (!walker.enter(node)) {
+                pending = node->isEndOfNode() ? nullptr : node + 1;
+                return;
+            }
+            stack.push_back(node);
+        }
+    }
+
+private:
+    // The edge list holding the node at this depth of the stack
+    Node const *list(size_t depth) const { return depth == 0 ? dawg.begin() : dawg.children(stack[depth - 1]); }
+
+    // The node at an offset in an edge list, or null if the list is shorter
+    static Node const *at(Node const *node, size_t offset) {
+        for (; node && node->getChar() != 0 && offset && !node->isEndOfNode(); --offset) {
+            ++node;
+        }
+        return node && node->getChar() != 0 && !offset ? node : nullptr;
+    }
+
+    static std::string hex(size_t value, int digits) {
+        static char const symbols[] = "0123456789abcdef";
+        std::string result(digits, '0');
+        for (int i = digits - 1; i >= 0; --i, value >>= 4) {
+            result[i] = symbols[value & 15];
+        }
+        return result;
+    }
+
+    void rewind() {
+        for (; !stack.empty(); stack.pop_back()) {
+            walker.leave();
+        }
+        pending = dawg.begin();
+    }
+
+    View dawg;
+    Walker walker;
+    uint32_t lexicon { 0 };
+    std::vector<Node const *> stack;
+    Node const *pending { nullptr }; // the next node to try, or null to go back up
+};
+
+/* The words of a lexicon, or those with a prefix, as a range that produces each
+ * one only when its iterator reaches it, so that standard algorithms can run
+ * over a lexicon and stop part way without the rest being visited.  Each word
+ * is the iterator's own buffer, which is reused for the next, so a reference to
+ * one lasts only until the iterator moves on and the iterators are input
+ * iterators, like istream_iterator; copying one copies its stack, so that the
+ * two move on independently.
+ */
+template <class Layout, class Walker = Prefixed>
+struct BasicWords {
+    struct iterator {
+        typedef std::input_iterator_tag iterator_category;
+        typedef std::string value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::string const *pointer;
+        typedef std::string const& reference;
+
+        iterator() = default;
+        explicit iterator(BasicEnumeration<Layout, Walker> const& start) : results(start), done(!results.next()) {}
+
+        reference operator*() const { return results.word(); }
+        pointer operator->() const { return &results.word(); }
+
+        iterator& operator++() {
+            done = !results.next();
+            return *this;
+        }
+        iterator operator++(int) {
+            auto before = *this;
+            ++*this;
+            return before;
+        }
+
+        bool operator==(iterator const& other) const { return done == other.done && (done || results == other.results); }
+        bool operator!=(iterator const& other) const { return !(*this == other); }
+
+    private:
+        BasicEnumeration<Layout, Walker> results;
+        bool done { true };
+    };
+
+    explicit BasicWords(BasicView<Layout> const& dawg, Walker const& walker = Walker()) : start(dawg, walker) {}
+
+    iterator begin() const { return iterator(start); }
+    iterator end() const { return iterator(); }
+
+private:
+    BasicEnumeration<Layout, Walker> start;
+};
+
+template <class Layout>
+BasicWords<Layout> words(BasicView<Layout> const& dawg, std::string const& prefix = std::string()) {
+    return BasicWords<Layout>(dawg, Prefixed(prefix));
+}
+
+/* A query combining any number of constraints, separated by spaces:
+ *
+ *   len:N or len:M-N   the number of letters, where either end of a range may be left out
+ *   prefix:ABC         the first letters
+ *   pattern:??A*       a pattern, as for Pattern
+ *   letters:AEIRST??   uses each letter at most as often as it is given, where '?' is a blank
+ *   in:<lexicon>       is also in another lexicon
+ *   not-in:<lexicon>   is not in another lexicon
+ *
+ * The constraints are compiled into a single traversal of the graph in which
+ * each one cuts off a subtree as soon as no word below can satisfy it: the
+ * length and prefix by position, the pattern when no position in it can be
+ * reached, the letters when none of the right ones is left, and another
+ * lexicon that the word must be in when it has no such prefix.  The other
+ * lexicons are walked in step with this one, and are named in whatever way
+ * the resolver understands.
+ */
+struct Query {
+    typedef std::function<std::shared_ptr<Lexicon const>(std::string const&)> Resolver;
+
+    static std::shared_ptr<Lexicon const> open(std::string const& spec) {
+        return std::make_shared<Lexicon>(spec);
+    }
+
+    explicit Query(std::string const& text, Alphabet const *alphabet = nullptr, Resolver const& resolve = open) {
+        std::istringstream constraints(text);
+        for (std::string constraint; constraints >> constraint; ) {
+            auto colon = constraint.find(':');
+            auto kind = constraint.substr(0, colon);
+            auto value = colon == std::string::npos ? std::string() : constraint.substr(colon + 1);
+            if (colon == std::string::npos || value.empty()) {
+                throw std::invalid_argument("Expected <constraint>:<value> but got " + constraint);
+            }
+            else if (kind == "len") {
+                auto dash = value.find('-');
+                auto low = value.substr(0, dash);
+                auto high = (dash == std::string::npos) ? low : value.substr(dash + 1);
+                min_length = std::max<size_t>(min_length, low.empty() ? 0 : std::stoul(low));
+                max_length = std::min<size_t>(max_length, high.empty() ? size_t(-1) : std::stoul(high));
+            }
+            else if (kind == "prefix") {
+                prefix = alphabet ? alphabet->encode(value) : value;
+            }
+            else if (kind == "pattern") {
+                pattern.reset(new Pattern(value, alphabet));
+            }
+            else if (kind == "letters") {
+                limited = true;
+                countTiles(value, alphabet, tiles);
+            }
+            else if (kind == "in" || kind == "not-in") {
+                if (others.size() == 64) {
+                    throw std::invalid_argument("Too many other lexicons in query");
+                }
+                if (kind == "in") {
+                    wanted |= uint64_t(1) << others.size();
+                }
+                others.push_back(resolve(value));
+            }
+            else {
+                throw std::invalid_argument("Unknown constraint (" + constraint + ")");
+            }
+        }
+    }
+
+    // Walk the graph on this many workers; the results are in lexicon order
+    // unless that is not wanted, in which case they come in no particular order
+    Query& parallel(unsigned count, bool in_order = true) {
+        workers = count;
+        ordered = in_order;
+        return *this;
+    }
+
+    Query& limit(Limits const& bounds) {
+        limits = bounds;
+        return *this;
+    }
+
+    // Call fn with every word satisfying all of the constraints.  Returns false if the
+    // limits stopped the search with only some of the results.
+    template <class Layout, class F>
+    bool run(BasicView<Layout> const& dawg, F const& fn) const {
+        Walker walker(*this);
+        Budget budget(limits);
+        execute(dawg, dawg.begin(), walker, fn, workers, ordered, budget);
+        return !budget.truncated();
+    }
+
+private:
+    // Follows the query down the current path, with the state of each constraint at each depth
+    struct Walker {
+        explicit Walker(Query const& query) : query(&query), counts(query.tiles) {
+            states.push_back(query.pattern ? query.pattern->start() : 0);
+            in_others.push_back(0);
+            for (auto const& other : query.others) {
+                trail.push_back(other->view().begin());
+            }
+        }
+
+        template <class Node>
+        bool enter(Node const *node) {
+            auto depth = path.size();
+            auto c = node->getChar();
+            if (depth >= query->max_length ||
+                (depth < query->prefix.size() && c != static_cast<unsigned char>(query->prefix[depth]))) {
+                return false;
+            }
+            auto next = query->pattern ? query->pattern->step(states.back(), c) : 0;
+            if (query->pattern && !next) {
+                return false;
+            }
+            // Use the letter itself if we have it, otherwise a blank
+            int tile = !query->limited ? -1 : counts[c] ? c : counts[0] ? 0 : -2;
+            uint64_t in = 0;
+            if (tile == -2 || !follow(depth, c, in)) {
+                return false;
+            }
+            if (tile >= 0) {
+                --counts[tile];
+            }
+            path.push_back(c);
+            states.push_back(next);
+            tiles.push_back(tile);
+            in_others.push_back(in);
+            return true;
+        }
+
+        bool accepts() const {
+            return path.size() >= query->min_length && path.size() >= query->prefix.size() &&
+                   (!query->pattern || query->pattern->accepts(states.back())) && in_others.back() == query->wanted;
+        }
+
+        void leave() {
+            if (tiles.back() >= 0) {
+                ++counts[tiles.back()];
+            }
+            path.pop_back();
+            states.pop_back();
+            tiles.pop_back();
+            in_others.pop_back();
+        }
+
+        std::string const& word() const { return path; }
+
+    private:
+        // Move each other lexicon on by letter c from its list at this depth, setting a bit in
+        // in for each that has a word ending there.  Returns false if a lexicon that the word
+        // must be in has no such prefix.
+        bool follow(size_t depth, unsigned char c, uint64_t& in) {
+            auto const& others = query->others;
+            trail.resize((depth + 2) * others.size());
+            auto here = trail.begin() + depth * others.size();
+            for (size_t i = 0; i < others.size(); ++i) {
+                auto node = here[i] ? View::find(here[i], c) : nullptr;
+                if (!node && ((query->wanted >> i) & 1)) {
+                    return false;
+                }
+                if (node && node->isEndOfWord()) {
+                    in |= uint64_t(1) << i;
+                }
+                here[others.size() + i] = node ? others[i]->view().children(node) : nullptr;
+            }
+            return true;
+        }
+
+        Query const *query;
+        std::string path;
+        std::vector<Pattern::States> states;
+        std::array<unsigned, MAX_CHARS> counts;
+        std::vector<int> tiles;               // the tile used at each depth, if any
+        std::vector<uint64_t> in_others;      // the other lexicons with the word at each depth
+        std::vector<Node const *> trail;      // the edge list reached in each other lexicon, at each depth
+    };
+
+    size_t min_length { 0 };
+    size_t max_length { size_t(-1) };
+    std::string prefix;
+    std::unique_ptr<Pattern> pattern;
+    bool limited { false };
+    std::array<unsigned, MAX_CHARS> tiles {};
+    std::vector<std::shared_ptr<Lexicon const>> others;
+    uint64_t wanted { 0 }; // a bit for each other lexicon that the word must be in
+    unsigned workers { 1 };
+    bool ordered { true };
+    Limits limits;
+};
+
+/* The queries that can be made of a lexicon.  Each calls fn with every matching
+ * word, in lexicon order unless asked to run in parallel without it, and returns
+ * false if its limits stopped it with only some of them.  For a lexicon built
+ * with an alphabet, the queries and their results are in UTF-8 and are
+ * translated to and from its codes.
+ */
+template <class Layout>
+struct BasicSearch {
+    typedef BasicNode<Layout> Node;
+    typedef BasicView<Layout> View;
+
+    explicit BasicSearch(View const& dawg, Alphabet const *alphabet = nullptr) : dawg(dawg), alphabet(alphabet) {}
+
+    template <class F>
+    bool lookup(std::string const& word, F const& fn) const {
+        std::string letters;
+        if (encode(word, letters) && dawg.contains(letters)) {
+            fn(word);
+        }
+        return true;
+    }
+
+    template <class F>
+    bool prefix(std::string const& start, F const& fn) const {
+        Prefixed walker;
+        Decoded<F> report { alphabet, fn };
+        Budget budget(limits);
+        if (!encode(start, walker.path)) {
+            return true;
+        }
+        walker.prefix = walker.path;
+        if (walker.path.empty()) {
+            execute(dawg, dawg.begin(), walker, report, workers, ordered, budget);
+        }
+        else if (auto node = dawg.walk(walker.path)) {
+            if (node->isEndOfWord()) {
+                if (!budget.claim()) {
+                    return false;
+                }
+                report(walker.path);
+            }
+            execute(dawg, dawg.children(node), walker, report, workers, ordered, budget);
+        }
+        return !budget.truncated();
+    }
+
+    template <class F>
+    bool pattern(std::string const& text, F const& fn) const {
+        Pattern compiled(text, alphabet);
+        Matching walker(compiled);
+        Budget budget(limits);
+        execute(dawg, dawg.begin(), walker, Decoded<F> { alphabet, fn }, workers, ordered, budget);
+        return !budget.truncated();
+    }
+
+    // Words using exactly the given letters, where '?' is a blank
+    template <class F>
+    bool anagram(std::string const& letters, F const& fn) const {
+        UsingLetters walker;
+        walker.remaining = countTiles(letters, alphabet, walker.counts);
+        Budget budget(limits);
+        execute(dawg, dawg.begin(), walker, Decoded<F> { alphabet, fn }, workers, ordered, budget);
+        return !budget.truncated();
+    }
+
+    // Run a query named by a string, as received from the command line or a client
+    template <class F>
+    bool run(std::string const& query, std::string const& argument, F const& fn) const {
+        if (query == "lookup") {
+            return lookup(argument, fn);
+        }
+        else if (query == "prefix") {
+            return prefix(argument, fn);
+        }
+        else if (query == "pattern") {
+            return pattern(argument, fn);
+        }
+        else if (query == "anagram") {
+            return anagram(argument, fn);
+        }
+        else {
+            throw std::invalid_argument("Unknown query (" + query + ")");
+        }
+    }
+
+    // Call fn with up to count results of a prefix, pattern or anagram query, in
+    // lexicon order, carrying on from the cursor returned for an earlier page or
+    // else from the first result at or after a word.  Sets the cursor to the
+    // position for the next page, or to an empty string if there are no more
+    // results, and returns false if the limits stopped the page short.
+    template <class F>
+    bool page(std::string const& query, std::string const& argument, std::string& cursor, size_t count,
+              F const& fn, std::string const& from = std::string()) const {
+        if (count == 0) {
+            throw std::invalid_argument("A page must hold at least one result");
+        }
+        if (query == "prefix") {
+            std::string letters;
+            if (!encode(argument, letters)) {
+                cursor.clear();
+                return true;
+            }
+            return paginate(Prefixed(letters), cursor, from, count, fn);
+        }
+        else if (query == "pattern") {
+            Pattern compiled(argument, alphabet);
+            return paginate(Matching(compiled), cursor, from, count, fn);
+        }
+        else if (query == "anagram") {
+            UsingLetters walker;
+            walker.remaining = countTiles(argument, alphabet, walker.counts);
+            return paginate(walker, cursor, from, count, fn);
+        }
+        else {
+            throw std::invalid_argument("Unknown query (" + query + ")");
+        }
+    }
+
+    // The fingerprint of the lexicon for cursors, if it is already known; otherwise
+    // each page works it out
+    BasicSearch& identify(uint64_t fingerprint) {
+        lexicon = fingerprint;
+        return *this;
+    }
+
+    // Walk the graph on this many workers; the results are in lexicon order
+    // unless that is not wanted, in which case they come in no particular order
+    BasicSearch& parallel(unsigned count, bool in_order = true) {
+        workers = count;
+        ordered = in_order;
+        return *this;
+    }
+
+    BasicSearch& limit(Limits const& bounds) {
+        limits = bounds;
+        return *this;
+    }
+
+private:
+    // Passes on each result, translated back to UTF-8 if there is an alphabet
+    template <class F>
+    struct Decoded {
+        Alphabet const *alphabet;
+        F const& fn;
+
+        void operator()(std::string const& word) const {
+            if (alphabet) {
+                fn(alphabet->decode(word));
+            }
+            else {
+                fn(word);
+            }
+        }
+    };
+
+    bool encode(std::string const& text, std::string& letters) const {
+        if (alphabet) {
+            return alphabet->encode(text, letters);
+        }
+        letters = text;
+        return true;
+    }
+
+    template <class Walker, class F>
+    bool paginate(Walker const& walker, std::string& cursor, std::string const& from, size_t count, F const& fn) const {
+        BasicEnumeration<Layout, Walker> results(dawg, walker, uint32_t(lexicon ? lexicon : dawg.fingerprint()));
+        if (!from.empty()) {
+            results.seek(alphabet ? alphabet->encode(from) : from);
+        }
+        else {
+            results.resume(cursor);
+        }
+        Decoded<F> report { alphabet, fn };
+        Budget budget(limits);
+        Meter meter(budget, 1);
+        for (size_t i = 0; i < count; ++i) {
+            if (!results.next(&meter)) {
+                // Stopped by the limits, the page can be carried on from where it got to
+                cursor = budget.truncated() ? results.cursor() : std::string();
+                return !budget.truncated();
+            }
+            report(results.word());
+        }
+        cursor = results.cursor();
+        return true;
+    }
+
+    View dawg;
+    Alphabet const *alphabet;
+    unsigned workers { 1 };
+    bool ordered { true };
+    Limits limits;
+    uint64_t lexicon { 0 }; // its fingerprint, if known
+};
+
+typedef BasicSearch<ZyzzyvaLayout> Search;
+
+// Case folding for queries made with text
+enum class Fold { none, upper, lower };
+
+std::array<unsigned char, MAX_CHARS> foldTable(Fold fold) {
+    std::array<unsigned char, MAX_CHARS> table;
+    for (unsigned c = 0; c < table.size(); ++c) {
+        table[c] = fold == Fold::upper ? std::toupper(c) : fold == Fold::lower ? std::tolower(c) : c;
+    }
+    return table;
+}
+
+/* Splits text written without spaces, such as hashtags and compounds, into
+ * lexicon words.  Working back from the end of the text, each position walks
+ * the graph forward from the root to find every word starting there, and keeps
+ * the split of the rest that leaves the fewest letters outside any word and
+ * then has the fewest words, preferring the longer word on a tie.  Letters that
+ * cannot be part of any word are kept together as a token of their own.
+ */
+struct Segmenter {
+    explicit Segmenter(View const& dawg, Fold fold = Fold::none) : dawg(dawg), table(foldTable(fold)) {}
+
+    // The text with a space between each of the tokens of its best split
+    std::string split(std::string const& text) const {
+        // cost[i] is (letters outside words, tokens) for the best split from i, whose first token ends at end[i]
+        size_t n = text.size();
+        std::vector<std::pair<size_t, size_t>> cost(n + 1);
+        std::vector<size_t> end(n + 1, n);
+        std::vector<bool> word(n + 1, false);
+        for (size_t i = n; i-- > 0; ) {
+            cost[i] = std::make_pair(cost[i + 1].first + 1, cost[i + 1].second + 1);
+            end[i] = i + 1;
+            dawg.wordsAt(text.data() + i, text.data() + n, [&](size_t length) {
+                auto split = std::make_pair(cost[i + length].first, cost[i + length].second + 1);
+                if (split <= cost[i]) {
+                    cost[i] = split;
+                    end[i] = i + length;
+                    word[i] = true;
+                }
+            }, table.data());
+        }
+
+        std::string result;
+        bool outside = false; // whether the last token is made of letters outside any word
+        for (size_t i = 0; i < n; i = end[i]) {
+            if (!result.empty() && (word[i] || !outside)) {
+                result.push_back(' ');
+            }
+            result.append(text, i, end[i] - i);
+            outside = !word[i];
+        }
+        return result;
+    }
+
+    // Split a batch of lines in parallel
+    std::vector<std::string> split(std::vector<std::string> const& lines) const {
+        std::vector<std::string> results(lines.size());
+        parallelFor(lines.size(), concurrency(), [&](unsigned, size_t line) { results[line] = split(lines[line]); });
+        return results;
+    }
+
+private:
+    View dawg;
+    std::array<unsigned char, MAX_CHARS> table;
+};
+
+/* Finds every occurrence of a lexicon word in a text, by walking the graph
+ * forward from each offset in the text until no edge matches.  The text is
+ * split into chunks of starting offsets that are scanned in parallel, a round
+ * at a time, and the matches are reported in order of offset and then length.
+ * Matches may also be restricted to whole tokens, which start and end at a
+ * boundary between a letter or digit and anything else.
+ */
+struct Scanner {
+    static constexpr size_t chunk_size = 1 << 20;
+
+    Scanner(View const& dawg, Fold fold = Fold::none, bool tokens = false)
+        : dawg(dawg), table(foldTable(fold)), tokens(tokens) {}
+
+    // Call fn(offset, length) for every match
+    template <class F>
+    void scan(char const *text, size_t size, F const& fn) const {
+        size_t chunks = (size + chunk_size - 1) / chunk_size;
+        unsigned workers = concurrency();
+        std::vector<std::vector<std::pair<size_t, size_t>>> found(workers * 4);
+        for (size_t first = 0; first < chunks; first += found.size()) {
+            size_t round = std::min(found.size(), chunks - first);
+            parallelFor(round, workers, [&](unsigned, size_t i) {
+                found[i].clear();
+                size_t start = (first + i) * chunk_size;
+                size_t end = std::min(size, start + chunk_size);
+                for (size_t offset = start; offset < end; ++offset) {
+                    if (tokens && offset > 0 && inToken(text[offset - 1])) {
+                        continue;
+                    }
+                    dawg.wordsAt(text + offset, text + size, [&](size_t length) {
+                        if (!tokens || offset + length == size || !inToken(text[offset + length])) {
+                            found[i].emplace_back(offset, length);
+                        }
+                    }, table.data());
+                }
+            });
+            for (size_t i = 0; i < round; ++i) {
+                for (auto const& match : found[i]) {
+                    fn(match.first, match.second);
+                }
+            }
+        }
+    }
+
+private:
+    static bool inToken(char c) {
+        auto u = static_cast<unsigned char>(c);
+        return std::isalnum(u) || u >= 0x80; // UTF-8 letters are all part of a token
+    }
+
+    View dawg;
+    std::array<unsigned char, MAX_CHARS> table;
+    bool tokens;
+};
+
+/* Answers queries against memory-resident lexicons over a Unix domain socket.
+ * Each request and response is a 32-bit big-endian length followed by that many
+ * bytes.  A request is "<query> <lexicon> <argument>" and the response is either
+ * "OK <count>" followed by one result per line, or "ERROR <reason>".  Every query
+ * runs within the server's limits, and one that they stop early is answered with
+ * "OK <count> TRUNCATED" and the results it found.
+ *
+ * A page of results is requested as "page <lexicon> <query> <count> <cursor>
+ * <argument>", where the cursor is "-" for the first page, and the response
+ * ends its first line with "NEXT <cursor>" while there may be more.
+ *
+ * Lexicons are reloaded when their files change on disk.  Each query takes its
+ * own reference to the current snapshot, so queries already in progress finish
+ * against the old one, which is freed when the last of them completes.
+ */
+struct Server {
+    explicit Server(std::vector<std::pair<std::string, std::string>> const& names_and_paths,
+                    Limits const& limits = Limits()) : limits(limits) {
+        for (auto const& entry : names_and_paths) {
+            lexicons.emplace_back(new Slot { entry.first, entry.second, {}, nullptr });
+            if (!reload(*lexicons.back())) {
+                throw std::runtime_error("Unable to load " + entry.second);
+            }
+        }
+    }
+
+    void run(std::string const& path) {
+        std::signal(SIGPIPE, SIG_IGN);
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        auto address = socketAddress(path);
+        ::unlink(path.c_str());
+        if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0) {
+            throw std::runtime_error("Unable to listen on " + path + ": " + std::strerror(errno));
+        }
+
+        std::thread(&Server::watch, this).detach();
+        for (;;) {
+            // Leave any more clients waiting in the listen queue until a connection closes
+            {
+                std::unique_lock<std::mutex> hold(lock);
+                vacancy.wait(hold, [this] { return active < connections; });
+            }
+            int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0) {
+                continue;
+            }
+            try {
+                std::lock_guard<std::mutex> hold(lock);
+                std::thread(&Server::converse, this, client).detach();
+                ++active;
+            }
+            catch (std::exception const& e) {
+                std::cerr << "Unable to serve a connection: " << e.what() << "\n";
+                ::close(client);
+            }
+        }
+    }
+
+    // The most clients served at once
+    Server& limitConnections(unsigned count) {
+        connections = std::max(count, 1u);
+        return *this;
+    }
+
+    // Send a single request to a server and return its response
+    static std::string request(std::string const& path, std::string const& query) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        auto address = socketAddress(path);
+        std::string response;
+        bool ok = fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+            writeFrame(fd, query) && readFrame(fd, response, max_response);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (!ok) {
+            throw std::runtime_error("No response from " + path);
+        }
+        return response;
+    }
+
+private:
+    struct Slot {
+        std::string name;
+        std::string path;
+        struct stat stamp;
+        std::shared_ptr<Lexicon const> current;
+    };
+
+    static constexpr uint32_t max_request = 65536;
+    static constexpr size_t max_page = 10000; // results in one page
+    static constexpr uint32_t max_response = 0xffffffffu;
+
+    static sockaddr_un socketAddress(std::string const& path) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path is too long: " + path);
+        }
+        std::strcpy(address.sun_path, path.c_str());
+        return address;
+    }
+
+    static bool readFrame(int fd, std::string& frame, uint32_t limit) {
+        uint32_t length;
+        if (!readAll(fd, reinterpret_cast<char *>(&length), sizeof(length)) || (length = ntohl(length)) > limit) {
+            return false;
+        }
+        frame.resize(length);
+        return readAll(fd, &frame[0], length);
+    }
+
+    static bool writeFrame(int fd, std::string const& frame) {
+        uint32_t length = htonl(frame.size());
+        return writeAll(fd, reinterpret_cast<char const *>(&length), sizeof(length)) &&
+            writeAll(fd, frame.data(), frame.size());
+    }
+
+    static bool readAll(int fd, char *data, size_t size) {
+        while (size) {
+            auto got = ::read(fd, data, size);
+            if (got <= 0 && !(got < 0 && errno == EINTR)) {
+                return false;
+            }
+            data += std::max<ssize_t>(got, 0);
+            size -= std::max<ssize_t>(got, 0);
+        }
+        return true;
+    }
+
+    static bool writeAll(int fd, char const *data, size_t size) {
+        while (size) {
+            auto sent = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            if (sent <= 0) {
+                return false;
+            }
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    // Load the lexicon again if its file has changed, keeping the old one if that fails.
+    // Lexicons in shared memory are attached once and are never reloaded.
+    static bool reload(Slot& lexicon) {
+        struct stat now {};
+        auto file = Lexicon::source(lexicon.path);
+        if (lexicon.current && file.empty()) {
+            return true;
+        }
+        if (!file.empty() && ::stat(file.c_str(), &now) != 0) {
+            return false;
+        }
+        auto& then = lexicon.stamp;
+        if (lexicon.current && now.st_ino == then.st_ino && now.st_size == then.st_size &&
+            now.st_mtim.tv_sec == then.st_mtim.tv_sec && now.st_mtim.tv_nsec == then.st_mtim.tv_nsec) {
+            return true;
+        }
+        try {
+            std::shared_ptr<Lexicon const> snapshot(new Lexicon(lexicon.path));
+            std::atomic_store(&lexicon.current, snapshot);
+            lexicon.stamp = now;
+            return true;
+        }
+        catch (std::exception const& e) {
+            std::cerr << "Unable to load " << lexicon.path << ": " << e.what() << "\n";
+            return false;
+        }
+    }
+
+    void watch() {
+        for (;;) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            for (auto& lexicon : lexicons) {
+                reload(*lexicon);
+            }
+        }
+    }
+
+    void converse(int fd) {
+        std::string query;
+        while (readFrame(fd, query, max_request) && writeFrame(fd, respond(query))) {
+        }
+        ::close(fd);
+        {
+            std::lock_guard<std::mutex> hold(lock);
+            --active;
+        }
+        vacancy.notify_one();
+    }
+
+    std::shared_ptr<Lexicon const> current(std::string const& name) const {
+        auto found = std::find_if(lexicons.cbegin(), lexicons.cend(),
+            [&](std::unique_ptr<Slot> const& lexicon) { return lexicon->name == name; });
+        if (found == lexicons.cend()) {
+            throw std::invalid_argument("Unknown lexicon (" + name + ")");
+        }
+        return std::atomic_load(&(*found)->current);
+    }
+
+    std::string respond(std::string const& query) {
+        std::istringstream fields(query);
+        std::string op, name, argument;
+        fields >> op >> name;
+        std::getline(fields >> std::ws, argument);
+
+        std::shared_ptr<Lexicon const> snapshot;
+        try {
+            snapshot = current(name);
+        }
+        catch (std::exception const& e) {
+            return std::string("ERROR ") + e.what() + "\n";
+        }
+        std::string results;
+        size_t count = 0;
+        auto report = [&](std::string const& word) {
+            results.append(word).push_back('\n');
+            ++count;
+        };
+        bool complete = true;
+        std::string next;
+        try {
+            if (op == "page") {
+                std::istringstream request(argument);
+                std::string query, cursor, rest;
+                size_t size = 0;
+                request >> query >> size >> cursor;
+                std::getline(request >> std::ws, rest);
+                next = cursor == "-" ? "" : cursor;
+                complete = Search(snapshot->view()).limit(limits).identify(snapshot->fingerprint())
+                    .page(query, rest, next, size > max_page ? size_t(max_page) : size, report);
+            }
+            else if (op == "query") {
+                // Other lexicons in a query are the ones this server holds
+                complete = Query(argument, nullptr, [&](std::string const& other) { return current(other); })
+                    .limit(limits).run(snapshot->view(), report);
+            }
+            else {
+                complete = Search(snapshot->view()).limit(limits).run(op, argument, report);
+            }
+        }
+        catch (std::exception const& e) {
+            return std::string("ERROR ") + e.what() + "\n";
+        }
+        return "OK " + std::to_string(count) + (complete ? "" : " TRUNCATED") + (next.empty() ? "" : " NEXT " + next) + "\n" +
+               results;
+    }
+
+    std::vector<std::unique_ptr<Slot>> lexicons;
+    Limits limits;
+    unsigned connections { 64 };
+    unsigned active { 0 };         // connections being served
+    std::mutex lock;               // guards active
+    std::condition_variable vacancy;
+};
+
+/* A query-only form of a DAWG in which every chain of nodes with a single child
+ * is collapsed into one edge carrying a multi-letter label, so that the long
+ * unbranching tails of words cost one memory access rather than one per letter.
+ * Each edge is two 32-bit words: the index of its child edge list (plus one)
+ * with flags for the end of a word and the end of its list, and the offset and
+ * length of its label in a pool of letters that follows the edges:
+ *
+ *   header, edges (root edge list first), label pool
+ */
+struct CompressedDawg {
+    static constexpr uint32_t magic = 0x43474457u; // "WDGC"
+    static constexpr uint32_t version = 1;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t edges;
+        uint32_t label_bytes;
+    };
+
+    struct Edge {
+        static constexpr uint32_t end_of_word = 0x80000000u;
+        static constexpr uint32_t end_of_list = 0x40000000u;
+        static constexpr uint32_t child_mask  = 0x3fffffffu;
+        static constexpr uint32_t max_label   = 0xffu;
+        static constexpr uint32_t max_offset  = 0x00ffffffu; // of a label in the pool
+
+        bool isEndOfWord() const { return (link & end_of_word) != 0; }
+        bool isEndOfList() const { return (link & end_of_list) != 0; }
+        uint32_t getChild() const { return link & child_mask; }
+        uint32_t labelOffset() const { return label >> 8; }
+        uint32_t labelLength() const { return label & max_label; }
+
+        uint32_t link;
+        uint32_t label;
+    };
+
+    static void build(View const& source, std::ostream&& os) {
+        Builder builder(source);
+        Header header { magic, version, uint32_t(builder.edges.size()), uint32_t(builder.labels.size()) };
+        os.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        os.write(reinterpret_cast<char const *>(builder.edges.data()), builder.edges.size() * sizeof(Edge));
+        os.write(builder.labels.data(), builder.labels.size());
+        if (!os) {
+            throw std::runtime_error("Unable to write compressed DAWG");
+        }
+    }
+
+    static bool recognise(std::string const& path) {
+        std::ifstream is(path, std::ios::in | std::ios::binary);
+        uint32_t first = 0;
+        return is.read(reinterpret_cast<char *>(&first), sizeof(first)) && first == magic;
+    }
+
+    explicit CompressedDawg(std::string const& path) : file(path) {
+        auto header = reinterpret_cast<Header const *>(file.data());
+        if (file.size() < sizeof(Header) || header->magic != magic || header->version != version ||
+            file.size() != sizeof(Header) + header->edges * sizeof(Edge) + header->label_bytes) {
+            throw std::runtime_error(path + " is not a compressed DAWG");
+        }
+        edges = reinterpret_cast<Edge const *>(header + 1);
+        count = header->edges;
+        labels = reinterpret_cast<char const *>(edges + count);
+
+        // Every label must lie in the pool and every list must end, and as the builder
+        // puts each list before the lists that lead to it, apart from the root list,
+        // each child must come after the root list and before its parent, so that no
+        // walk can leave the file or go round in a cycle
+        size_t root = 0;
+        while (root < count && !edges[root].isEndOfList()) {
+            ++root;
+        }
+        ++root; // counting the edge that ends the list
+        for (size_t i = 0; i < count; ++i) {
+            auto const& edge = edges[i];
+            auto child = edge.getChild();
+            if (edge.labelLength() == 0 || uint64_t(edge.labelOffset()) + edge.labelLength() > header->label_bytes ||
+                (child != 0 && (child - 1 < root || child > count || (i >= root && child - 1 >= i))) ||
+                (i + 1 == count && !edge.isEndOfList())) {
+                throw std::runtime_error(path + " is corrupt");
+            }
+        }
+    }
+
+    bool contains(std::string const& word) const {
+        size_t matched = 0;
+        auto edge = walk(word, matched);
+        return edge && matched == word.size() && !word.empty() && edge->isEndOfWord();
+    }
+
+    // Call fn with every word starting with 'start', in lexicon order, as far as the
+    // meter allows each edge and result; returns false if the meter stopped it
+    template <class F>
+    bool prefix(std::string const& start, F const& fn, Meter *meter = nullptr) const {
+        if (start.empty()) {
+            std::string word;
+            return forEach(count ? edges : nullptr, word, fn, meter);
+        }
+        size_t matched = 0;
+        auto edge = walk(start, matched);
+        if (edge && matched >= start.size()) {
+            // The prefix may end part way through the last edge's label
+            std::string word = start.substr(0, matched - edge->labelLength());
+            return forEachBelow(edge, word, fn, meter);
+        }
+        return true;
+    }
+
+    template <class F>
+    void forEach(F const& fn) const { prefix(std::string(), fn); }
+
+private:
+    // Follow as much of 'word' as possible, returning the last edge entered and setting
+    // 'matched' to the length of the word up to the end of that edge's label
+    Edge const *walk(std::string const& word, size_t& matched) const {
+        Edge const *list = count ? edges : nullptr;
+        Edge const *edge = nullptr;
+        matched = 0;
+        while (list && matched < word.size()) {
+            edge = find(list, word[matched]);
+            if (!edge) {
+                return nullptr;
+            }
+            auto length = std::min<size_t>(edge->labelLength(), word.size() - matched);
+            if (word.compare(matched, length, labels + edge->labelOffset(), length) != 0) {
+                return nullptr;
+            }
+            matched += edge->labelLength();
+            list = child(edge);
+        }
+        return matched >= word.size() ? edge : nullptr;
+    }
+
+    Edge const *find(Edge const *list, char c) const {
+        for (;; ++list) {
+            if (labels[list->labelOffset()] == c) {
+                return list;
+            }
+            if (list->isEndOfList()) {
+                return nullptr;
+            }
+        }
+    }
+
+    // The child edge list of an edge, which the constructor has checked is in the file
+    Edge const *child(Edge const *edge) const {
+        auto next = edge->getChild();
+        return next ? edges + next - 1 : nullptr;
+    }
+
+    template <class F>
+    bool forEach(Edge const *list, std::string& word, F const& fn, Meter *meter) const {
+        for (; list; ++list) {
+            if (!forEachBelow(list, word, fn, meter)) {
+                return false;
+            }
+            if (list->isEndOfList()) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    template <class F>
+    bool forEachBelow(Edge const *edge, std::string& word, F const& fn, Meter *meter) const {
+        if (meter && !meter->visit()) {
+            return false;
+        }
+        word.append(labels + edge->labelOffset(), edge->labelLength());
+        if (edge->isEndOfWord()) {
+            if (meter && !meter->claim()) {
+                return false;
+            }
+            fn(word);
+        }
+        bool complete = forEach(child(edge), word, fn, meter);
+        word.resize(word.size() - edge->labelLength());
+        return complete;
+    }
+
+    // Compiles each edge list of the source once, children before their parents
+    // apart from the root list, which always comes first
+    struct Builder {
+        explicit Builder(View const& source) : source(source) {
+            auto roots = source.roots();
+            edges.resize(roots.size());
+            auto root = compile(roots.empty() ? nullptr : roots.front());
+            std::copy(root.begin(), root.end(), edges.begin());
+        }
+
+        std::vector<Edge> compile(Node const *list) {
+            std::vector<Edge> result;
+            for (; list && list->getChar() != 0; ++list) {
+                // Follow the chain while each node has exactly one child and ends no word
+                std::string label(1, list->getChar());
+                auto last = list;
+                for (auto next = source.children(last);
+                     next && next->isEndOfNode() && !last->isEndOfWord() && label.size() < Edge::max_label;
+                     next = source.children(last)) {
+                    label.push_back(next->getChar());
+                    last = next;
+                }
+                Edge edge { last->isEndOfWord() ? Edge::end_of_word : 0, pool(label) };
+                if (auto below = source.children(last)) {
+                    auto found = compiled.find(source.indexOf(below));
+                    if (found == compiled.end()) {
+                        auto child = compile(below);
+                        if (edges.size() + 1 > Edge::child_mask) {
+                            throw std::runtime_error("Too many edges for the compressed DAWG format");
+                        }
+                        found = compiled.emplace(source.indexOf(below), edges.size() + 1).first;
+                        edges.insert(edges.end(), child.begin(), child.end());
+                    }
+                    edge.link |= found->second;
+                }
+                result.push_back(edge);
+                if (list->isEndOfNode()) {
+                    break;
+                }
+            }
+            if (!result.empty()) {
+                result.back().link |= Edge::end_of_list;
+            }
+            return result;
+        }
+
+        uint32_t pool(std::string const& label) {
+            auto found = pooled.emplace(label, labels.size());
+            if (found.second) {
+                if (found.first->second > Edge::max_offset) {
+                    throw std::runtime_error("Too many letters in labels for the compressed DAWG format");
+                }
+                labels.insert(labels.end(), label.begin(), label.end());
+            }
+            return (found.first->second << 8) | label.size();
+        }
+
+        View source;
+        std::vector<Edge> edges;
+        std::vector<char> labels;
+        std::unordered_map<size_t, uint32_t> compiled;
+        std::unordered_map<std::string, uint32_t> pooled;
+    };
+
+    MappedFile file;
+    Edge const *edges { nullptr };
+    size_t count { 0 };
+    char const *labels { nullptr };
+};
+
+/* Write a C++ header that compiles the node array into the program as a constant
+ * table, so that a tool with a fixed lexicon needs no file I/O or loading at all
+ * and the table is shared between processes as read-only program data.  Along
+ * with the table comes a view that can walk it, in constant expressions if need
+ * be, and the table can also be handed to zdawg_open_memory().
+ *
+ * The table is a static member of a class template, whose definition may be in
+ * a header and is merged by the linker, so that a program has one copy of it
+ * however many of its files include the header, even in C++11.
+ */
+void emitCpp(View const& dawg, std::string const& name, std::string const& source, std::ostream& os) {
+    auto hex = [](uint32_t value) {
+        char text[16];
+        std::snprintf(text, sizeof(text), "0x%08xu", value);
+        return std::string(text);
+    };
+    auto size = std::max<size_t>(dawg.size(), 1);
+    std::string guard;
+    for (char c : name) {
+        guard.push_back(std::toupper(static_cast<unsigned char>(c)));
+    }
+
+    os << "/* Generated by zyzzyva-dawg emit-cpp from " << source << " - do not edit */\n\n"
+       << "#ifndef " << guard << "_DAWG_H\n#define " << guard << "_DAWG_H\n\n"
+       << "#include <cstdint>\n\n"
+       << "namespace " << name << "_dawg {\n\n"
+       << "constexpr std::uint32_t node_count = " << dawg.size() << "u;\n\n"
+       << "template <class = void>\n"
+       << "struct Table {\n"
+       << "    alignas(4) static constexpr std::uint32_t nodes[" << size << "] = {";
+    for (size_t i = 0; i < dawg.size(); ++i) {
+        os << ((i % 6) ? " " : "\n        ") << hex(dawg[i].getValue()) << ",";
+    }
+    os << "\n    };\n};\n\n"
+       << "template <class T>\n"
+       << "constexpr std::uint32_t Table<T>::nodes[" << size << "];\n\n"
+       << "static constexpr std::uint32_t const (&nodes)[" << size << "] = Table<>::nodes;\n\n"
+       << "/* Node n has a letter, flags for the end of a word and the end of its edge\n"
+       << " * list, and the position of its child edge list plus one (zero for none).\n"
+       << " */\n"
+       << "struct Lexicon {\n"
+       << "    static constexpr unsigned char letter(std::uint32_t n) { return (nodes[n] & " << hex(ZyzzyvaLayout::letter_mask)
+       << ") >> " << ZyzzyvaLayout::letter_shift << "; }\n"
+       << "    static constexpr bool isEndOfWord(std::uint32_t n) { return (nodes[n] & " << hex(ZyzzyvaLayout::end_of_word) << ") != 0; }\n"
+       << "    static constexpr bool isEndOfNode(std::uint32_t n) { return (nodes[n] & " << hex(ZyzzyvaLayout::end_of_node) << ") != 0; }\n"
+       << "    static constexpr std::uint32_t child(std::uint32_t n) { return nodes[n] & " << hex(ZyzzyvaLayout::offset_mask) << "; }\n\n"
+       << "    // Search the edge list containing node n onwards for c, returning its position plus one\n"
+       << "    static constexpr std::uint32_t find(std::uint32_t n, unsigned char c) {\n"
+       << "        return letter(n) == c ? n + 1 : (letter(n) == 0 || isEndOfNode(n)) ? 0 : find(n + 1, c);\n"
+       << "    }\n\n"
+       << "    static constexpr bool contains(char const *word) {\n"
+       << "        return node_count > 0 && *word && walk(word, find(0, *word));\n"
+       << "    }\n\n"
+       << "private:\n"
+       << "    static constexpr bool walk(char const *word, std::uint32_t found) {\n"
+       << "        return found && (word[1] == '\\0' ? isEndOfWord(found - 1) :\n"
+       << "            child(found - 1) && walk(word + 1, find(child(found - 1) - 1, word[1])));\n"
+       << "    }\n"
+       << "};\n\n"
+       << "} // namespace " << name << "_dawg\n\n"
+       << "#endif\n";
+}
+
+} // namespace Dawg
+
+/* The C interface declared in zyzzyva-dawg.h.  Exceptions must not escape from
+ * any of these functions.
+ */
+struct zdawg {
+    template <class... Args>
+    explicit zdawg(Args&&... args) : lexicon(std::forward<Args>(args)...) {}
+
+    Dawg::Lexicon lexicon;
+    std::unique_ptr<Dawg::Alphabet> alphabet;
+};
+
+namespace {
+    struct StopSearch {};
+
+    // Run a search, passing each result to the caller's callback via the caller's buffer
+    template <class Run>
+    long report(zdawg const *dawg, char *buffer, size_t size, zdawg_word_fn fn, void *context, Run const& run,
+                zdawg_limits const *limits = nullptr, int *truncated = nullptr) {
+        long count = 0;
+        if (truncated) {
+            *truncated = 0;
+        }
+        try {
+            Dawg::Limits bounds;
+            if (limits && limits->timeout_ms) {
+                bounds.time = std::chrono::milliseconds(limits->timeout_ms);
+            }
+            if (limits && limits->max_nodes) {
+                bounds.nodes = limits->max_nodes;
+            }
+            if (limits && limits->max_results) {
+                bounds.results = limits->max_results;
+            }
+            Dawg::Search search(dawg->lexicon.view(), dawg->alphabet.get());
+            search.limit(bounds);
+            bool complete = run(search, bounds, [&](std::string const& word) {
+                if (word.size() >= size) {
+                    throw std::length_error("buffer too small");
+                }
+                word.copy(buffer, word.size());
+                buffer[word.size()] = '\0';
+                ++count;
+                if (fn(context, buffer, word.size())) {
+                    throw StopSearch();
+                }
+            });
+            if (truncated) {
+                *truncated = !complete;
+            }
+        }
+        catch (StopSearch const&) {
+        }
+        catch (...) {
+            return -1;
+        }
+        return count;
+    }
+} // namespace
+
+extern "C" {
+
+zdawg *zdawg_open(char const *path) {
+    try {
+        return new zdawg(std::string(path), true);
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+zdawg *zdawg_open_memory(uint32_t const *nodes, size_t count) {
+    try {
+        return new zdawg(Dawg::View(reinterpret_cast<Dawg::Node const *>(nodes), count));
+    }
+    catch (...) {
+        return nullptr;
+    }
+}
+
+void zdawg_close(zdawg *dawg) {
+    delete dawg;
+}
+
+int zdawg_alphabet(zdawg *dawg, char const *definition) {
+    try {
+        std::istringstream text(definition);
+        dawg->alphabet.reset(new Dawg::Alphabet(text));
+        return 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+int zdawg_lookup(zdawg const *dawg, char const *word) {
+    try {
+        std::string letters { word };
+        if (dawg->alphabet && !dawg->alphabet->encode(word, letters)) {
+            return 0;
+        }
+        return dawg->lexicon.view().contains(letters) ? 1 : 0;
+    }
+    catch (...) {
+        return -1;
+    }
+}
+
+long zdawg_prefix(zdawg const *dawg, char const *prefix, char *buffer, size_t size, zdawg_word_fn fn, void *context) {
+    return report(dawg, buffer, size, fn, context, [&](Dawg::Search const& search, Dawg::Limits const&,
+                                                      std::function<void(std::string const&)> const& each) {
+        return search.prefix(prefix, each);
+    });
+}
+
+long zdawg_pattern(zdawg const *dawg, char const *pattern, char *buffer, size_t size, zdawg_word_fn fn, void *context) {
+    return report(dawg, buffer, size, fn, context, [&](Dawg::Search const& search, Dawg::Limits const&,
+                                                      std::function<void(std::string const&)> const& each) {
+        return search.pattern(pattern, each);
+    });
+}
+
+long zdawg_anagram(zdawg const *dawg, char const *letters, char *buffer, size_t size, zdawg_word_fn fn, void *context) {
+    return report(dawg, buffer, size, fn, context, [&](Dawg::Search const& search, Dawg::Limits const&,
+                                                      std::function<void(std::string const&)> const& each) {
+        return search.anagram(letters, each);
+    });
+}
+
+long zdawg_search(zdawg const *dawg, char const *query, char const *argument, zdawg_limits const *limits,
+                  int *truncated, char *buffer, size_t size, zdawg_word_fn fn, void *context) {
+    return report(dawg, buffer, size, fn, context, [&](Dawg::Search const& search, Dawg::Limits const& bounds,
+                                                      std::function<void(std::string const&)> const& each) {
+        if (std::string(query) == "query") {
+            auto alphabet = dawg->alphabet.get();
+            return Dawg::Query(argument, alphabet).limit(bounds).run(dawg->lexicon.view(), [&](std::string const& word) {
+                each(alphabet ? alphabet->decode(word) : word);
+            });
+        }
+        return search.run(query, argument, each);
+    }, limits, truncated);
+}
+
+} // extern "C"
+
+#ifndef ZYZZYVA_DAWG_LIBRARY
+
+namespace {
+    /* The command line: positional arguments plus options of the form "--name value"
+     * (or just "--name" for those that are flags), which may appear anywhere.
+     */
+    struct Arguments {
+        Arguments(int argc, char *argv[], std::set<std::string> const& flags) {
+            for (int i = 1; i < argc; ++i) {
+                std::string arg { argv[i] };
+                if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+                    auto name = arg.substr(2);
+                    if (flags.count(name) || i + 1 == argc) {
+                        options[name] = "";
+                    }
+                    else {
+                        options[name] = argv[++i];
+                    }
+                }
+                else {
+                    positional.push_back(arg);
+                }
+            }
+        }
+
+        std::string operator[](size_t idx) const { return idx < positional.size() ? positional[idx] : ""; }
+
+        // Lexicons named from 'idx' onwards, each "name=file" or just a file named after its lexicon
+        std::vector<std::pair<std::string, std::string>> lexicons(size_t idx) const {
+            std::vector<std::pair<std::string, std::string>> result;
+            for (; idx < positional.size(); ++idx) {
+                auto const& file = positional[idx];
+                auto equals = file.find('=');
+                auto name = file.substr(0, equals);
+                if (equals == std::string::npos) {
+                    name = name.substr(name.find_last_of('/') + 1);
+                    name = name.substr(0, name.find('.'));
+                }
+                result.emplace_back(name, file.substr(equals + 1));
+            }
+            return result;
+        }
+        bool has(std::string const& name) const { return options.count(name) != 0; }
+        std::string option(std::string const& name, std::string const& fallback = "") const {
+            auto found = options.find(name);
+            return found == options.end() ? fallback : found->second;
+        }
+
+    private:
+        std::vector<std::string> positional;
+        std::map<std::string, std::string> options;
+    };
+
+    // The hash of a whole file, read a block at a time
+    std::string hash(std::string const& path) {
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        return Dawg::Metadata::Hasher(in).hash();
+    }
+
+    // Save a DAWG file along with its metadata, given the hash of its input
+    template <class Layout>
+    void save(Dawg::BasicDawg<Layout>& dawg, std::string const& path, std::string const& input_hash) {
+        dawg.save(std::ofstream(path, std::ios::out | std::ios::binary));
+        auto meta = Dawg::Metadata::describe(dawg.view(), Layout::name(), Dawg::Metadata::fileSize(path));
+        meta.input_hash = input_hash;
+        meta.built = Dawg::Metadata::now();
+        std::ofstream out(Dawg::Metadata::path(path), std::ios::out);
+        meta.write(out);
+    }
+
+    // Load a DAWG file, checking it against its metadata
+    template <class Layout>
+    void load(Dawg::BasicDawg<Layout>& dawg, std::string const& path) {
+        dawg.load(std::ifstream(path, std::ios::in | std::ios::binary));
+        Dawg::Metadata::validate(path, dawg.view());
+    }
+
+    // Zyzzyva DAWGs can also be copied from shared memory or an archive
+    void load(Dawg::Dawg& dawg, std::string const& spec) {
+        if (Dawg::Lexicon::source(spec) == spec) {
+            load<Dawg::ZyzzyvaLayout>(dawg, spec);
+        }
+        else {
+            dawg.load(Dawg::Lexicon(spec).view());
+        }
+    }
+
+    Dawg::Fold fold(Arguments const& args) {
+        auto fold = args.option("fold", "none");
+        if (fold != "none" && fold != "upper" && fold != "lower") {
+            throw std::invalid_argument("Unknown case folding (" + fold + ")");
+        }
+        return fold == "upper" ? Dawg::Fold::upper : fold == "lower" ? Dawg::Fold::lower : Dawg::Fold::none;
+    }
+
+    // The limits on a search, from --timeout (in milliseconds), --max-nodes and --max-results,
+    // where 0 means no limit as it does in zdawg_limits
+    Dawg::Limits limits(Arguments const& args) {
+        Dawg::Limits bounds;
+        if (auto timeout = std::stoul(args.option("timeout", "0"))) {
+            bounds.time = std::chrono::milliseconds(timeout);
+        }
+        if (auto nodes = std::stoull(args.option("max-nodes", "0"))) {
+            bounds.nodes = nodes;
+        }
+        if (auto results = std::stoull(args.option("max-results", "0"))) {
+            bounds.results = results;
+        }
+        return bounds;
+    }
+
+    // The number of workers to search with, from --threads, where 0 means one per core
+    unsigned threads(Arguments const& args) {
+        auto count = std::stoul(args.option("threads", "1"));
+        return count ? count : Dawg::concurrency();
+    }
+
+    // Build a DAWG in any layout from the word list named by the arguments
+    template <class Layout>
+    void create(Dawg::BasicDawg<Layout>& dawg, Arguments const& args, Dawg::Alphabet const *alphabet) {
+        std::ifstream file;
+        if (args[1] != "-") {
+            file.open(args[1], std::ios::in);
+        }
+        Dawg::Metadata::Hasher input(args[1] == "-" ? std::cin : file);
+        std::istream words(&input);
+        dawg.parse(words, alphabet);
+        if (args.has("share-tails")) {
+            dawg.shareTails();
+        }
+        save(dawg, args[2], input.hash());
+    }
+} // namespace
+
+int main(int argc, char *argv[])
+{
     Dawg::Dawg d;
 
     try {
-        std::string command { (argc > 1) ? argv[1] : "" };
-        std::string input   { (argc > 2) ? argv[2] : "" };
-        std::string output  { (argc > 3) ? argv[3] : "" };
+        Arguments args(argc, argv, { "share-tails", "archive", "tokens", "unordered" });
+        std::string command { args[0] };
+        std::string input   { args[1] };
+        std::string output  { args[2] };
+
+        // A lexicon created with an alphabet is read and searched with the same one
+        std::unique_ptr<Dawg::Alphabet> alphabet;
+        if (args.has("alphabet")) {
+            alphabet.reset(new Dawg::Alphabet(Dawg::Alphabet::load(args.option("alphabet"))));
+        }
 
-        if (command == "create") {
-            if (input == "-") {
-                d.parse(std::cin);
+        // Other commands treat letters as bytes, so would quietly ignore an alphabet
+        static const std::set<std::string> lettered {
+            "create", "dump", "search", "page", "query", "infix", "suffix", "anagrams", "changes", "probability",
+        };
+        if (alphabet && !lettered.count(command)) {
+            throw std::invalid_argument(command + " does not support --alphabet");
+        }
+        // Words read from the command line, in the letters stored in the lexicon
+        auto encoded = [&](std::string const& word) {
+            std::string letters;
+            return !alphabet ? word : alphabet->encode(word, letters) ? letters : std::string();
+        };
+        auto decoded = [&](std::string const& word) { return alphabet ? alphabet->decode(word) : word; };
+
+        // Set by a search that its limits stopped early
+        bool truncated = false;
+
+        if (command == "create" && args.option("format") == "wide") {
+            if (!alphabet) {
+                // The letters of the English lexicons, which are all a wide DAWG can hold without an alphabet
+                std::string letters;
+                for (char c = 'A'; c <= 'Z'; ++c) {
+                    letters += std::string(1, c) + "\n";
+                }
+                std::istringstream definition(letters);
+                alphabet.reset(new Dawg::Alphabet(definition));
             }
-            else {
-                std::ifstream in(input, std::ios::in);
-                d.parse(in);
+            Dawg::WideDawg wide;
+            create(wide, args, alphabet.get());
+        }
+        else if (command == "create") {
+            if (args.has("format") && args.option("format") != "zyzzyva") {
+                throw std::invalid_argument("Unknown DAWG format (" + args.option("format") + ")");
             }
-            d.save(std::ofstream(output, std::ios::out | std::ios::binary));
+            create(d, args, alphabet.get());
+        }
+        else if (command == "minimize") {
+            Dawg::Lexicon source(input);
+            d.rebuild(source.view());
+            if (args.has("share-tails")) {
+                d.shareTails();
+            }
+            save(d, output, hash(input));
+        }
+        else if (command == "filter") {
+            Dawg::WordFilter filter;
+            auto lengths = args.option("len");
+            if (!lengths.empty()) {
+                // "N" for exactly N letters, or a range "M-N" where either end may be left out
+                auto dash = lengths.find('-');
+                auto low = lengths.substr(0, dash);
+                auto high = (dash == std::string::npos) ? low : lengths.substr(dash + 1);
+                filter.min_length = low.empty() ? 0 : std::stoul(low);
+                filter.max_length = high.empty() ? size_t(-1) : std::stoul(high);
+            }
+            for (unsigned char c : args.option("exclude")) {
+                filter.excluded.set(c);
+            }
+            filter.prefix = args.option("prefix");
+
+            Dawg::Lexicon source(input);
+            d.rebuild(source.view(), filter);
+            if (args.has("share-tails")) {
+                d.shareTails();
+            }
+            save(d, output, hash(input));
+        }
+        else if (command == "compress") {
+            Dawg::Lexicon lexicon(input);
+            Dawg::CompressedDawg::build(lexicon.view(), std::ofstream(output, std::ios::out | std::ios::binary));
+        }
+        else if (command == "dump" && Dawg::CompressedDawg::recognise(input)) {
+            std::ofstream out(output, std::ios::out);
+            std::ostream& os = out ? out : std::cout;
+            Dawg::CompressedDawg(input).forEach([&](std::string const& word) { os << word << "\n"; });
+        }
+        else if (command == "dump" && Dawg::WideDawg::recognise(input)) {
+            Dawg::WideDawg wide;
+            load(wide, input);
+            std::ofstream out(output, std::ios::out);
+            wide.dump(out ? out : std::cout, alphabet.get());
         }
         else if (command == "dump") {
-            d.load(std::ifstream(input, std::ios::in | std::ios::binary));
+            // The words are read straight from the mapped lexicon as they are written out
+            Dawg::Lexicon lexicon(input, true);
             std::ofstream out(output, std::ios::out);
-            d.dump(out ? out : std::cout);
+            std::ostream& os = out ? out : std::cout;
+            for (auto const& word : Dawg::words(lexicon.view())) {
+                os << decoded(word) << "\n";
+            }
+        }
+        else if (command == "checksum" && Dawg::WideDawg::recognise(input)) {
+            Dawg::WideDawg wide;
+            load(wide, input);
+            std::ofstream out(output, std::ios::out);
+            wide.checksum(out ? out : std::cout);
         }
         else if (command == "checksum") {
-            d.load(std::ifstream(input, std::ios::in | std::ios::binary));
+            load(d, input);
             std::ofstream out(output, std::ios::out);
             d.checksum(out ? out : std::cout);
         }
+        else if (command == "stats") {
+            // Loading checks the metadata against the file; without any, gather it from the graph
+            Dawg::Metadata meta;
+            bool recorded = Dawg::Metadata::read(input, meta);
+            if (Dawg::WideDawg::recognise(input)) {
+                Dawg::WideDawg wide;
+                load(wide, input);
+                if (!recorded) {
+                    meta = Dawg::Metadata::describe(wide.view(), Dawg::WideLayout::name(), Dawg::Metadata::fileSize(input));
+                }
+            }
+            else {
+                Dawg::Lexicon lexicon(input, true);
+                if (!recorded) {
+                    meta = Dawg::Metadata::describe(lexicon.view(), Dawg::ZyzzyvaLayout::name(), Dawg::Metadata::fileSize(input));
+                }
+            }
+            std::ofstream out(output, std::ios::out);
+            meta.write(out ? out : std::cout);
+        }
+        else if (command == "infix" || command == "suffix") {
+            std::string text { output };
+            std::string results { args[3] };
+            Dawg::Lexicon lexicon(input);
+            std::ofstream out(results, std::ios::out);
+            std::ostream& os = out ? out : std::cout;
+            auto letters = encoded(text);
+            if (!letters.empty()) {
+                Dawg::Budget budget(limits(args));
+                Dawg::Meter meter(budget, 1);
+                // A saved index is mapped rather than built again for every query
+                std::unique_ptr<Dawg::InfixIndex> index(args.has("index")
+                    ? new Dawg::InfixIndex(lexicon.view(), args.option("index")) : new Dawg::InfixIndex(lexicon.view()));
+                truncated = !index->search(letters, command == "suffix",
+                    [&](std::string const& word) { os << decoded(word) << "\n"; }, &meter);
+            }
+        }
+        else if (command == "infixes") {
+            Dawg::Lexicon lexicon(input);
+            Dawg::InfixIndex::build(lexicon.view(), std::ofstream(output, std::ios::out | std::ios::binary));
+        }
+        else if (command == "alphagrams") {
+            Dawg::Lexicon lexicon(input);
+            Dawg::AlphagramIndex::build(lexicon.view(), std::ofstream(output, std::ios::out | std::ios::binary));
+        }
+        else if (command == "anagrams") {
+            std::string letters { args[3] };
+            std::string results { args[4] };
+            Dawg::Lexicon lexicon(input);
+            std::ofstream out(results, std::ios::out);
+            std::ostream& os = out ? out : std::cout;
+            auto codes = encoded(letters);
+            if (!codes.empty()) {
+                Dawg::Budget budget(limits(args));
+                Dawg::Meter meter(budget, 1);
+                truncated = !Dawg::AlphagramIndex(lexicon.view(), output).anagrams(codes,
+                    [&](std::string const& word) { os << decoded(word) << "\n"; }, &meter);
+            }
+        }
+        else if (command == "neighbours") {
+            Dawg::Lexicon lexicon(input);
+            Dawg::NeighbourIndex::build(lexicon.view(), std::ofstream(output, std::ios::out | std::ios::binary));
+        }
+        else if (command == "changes") {
+            std::string word { args[3] };
+            std::string results { args[4] };
+            Dawg::Lexicon lexicon(input);
+            std::ofstream out(results, std::ios::out);
+            std::ostream& os = out ? out : std::cout;
+            Dawg::Budget budget(limits(args));
+            Dawg::Meter meter(budget, 1);
+            truncated = !Dawg::NeighbourIndex(lexicon.view(), output).neighbours(encoded(word),
+                [&](std::string const& neighbour) { os << decoded(neighbour) << "\n"; }, &meter);
+        }
+        else if (command == "probability") {
+            Dawg::Lexicon lexicon(input);
+            auto blanks = std::stoul(args.option("blanks", "2"));
+            std::unique_ptr<Dawg::TileBag> bag;
+            if (args.has("tiles")) {
+                std::ifstream distribution(args.option("tiles"), std::ios::in);
+                if (!distribution) {
+                    throw std::runtime_error("Unable to open tiles " + args.option("tiles"));
+                }
+                bag.reset(new Dawg::TileBag(distribution, alphabet.get(), blanks));
+            }
+            else if (alphabet) {
+                throw std::invalid_argument("The English tiles do not fit an alphabet, so give --tiles too");
+            }
+            else {
+                bag.reset(new Dawg::TileBag(blanks));
+            }
+            auto lengths = Dawg::probabilityOrder(lexicon.view(), *bag, std::stoul(args.option("length", "0")));
+
+            if (args.has("table")) {
+                // One rank per word in the lexicon, zero for words not included
+                std::vector<uint32_t> ranks(Dawg::WordIndex(lexicon.view()).words(), 0);
+                for (auto const& words : lengths) {
+                    for (auto const& word : words) {
+                        ranks[word.number] = word.rank;
+                    }
+                }
+                std::ofstream table(args.option("table"), std::ios::out | std::ios::binary);
+                table.write(reinterpret_cast<char const *>(ranks.data()), ranks.size() * sizeof(uint32_t));
+            }
+
+            std::ofstream out(output, std::ios::out);
+            std::ostream& os = out ? out : std::cout;
+            for (auto const& words : lengths) {
+                for (auto const& word : words) {
+                    os << word.rank << "\t" << decoded(word.word) << "\t" << word.combinations << "\n";
+                }
+            }
+        }
+        else if (command == "search" && Dawg::CompressedDawg::recognise(input)) {
+            Dawg::CompressedDawg compressed(input);
+            if (threads(args) > 1) {
+                throw std::invalid_argument("Compressed DAWGs are searched on one thread");
+            }
+            auto print = [](std::string const& word) { std::cout << word << "\n"; };
+            Dawg::Budget budget(limits(args));
+            Dawg::Meter meter(budget, 1);
+            if (output == "lookup") {
+                if (compressed.contains(args[3])) {
+                    print(args[3]);
+                }
+            }
+            else if (output == "prefix") {
+                truncated = !compressed.prefix(args[3], print, &meter);
+            }
+            else {
+                throw std::invalid_argument("Compressed DAWGs support only lookup and prefix queries");
+            }
+        }
+        else if (command == "query") {
+            std::string constraints;
+            for (size_t i = 2; !args[i].empty(); ++i) {
+                constraints += args[i] + " ";
+            }
+            if (Dawg::WideDawg::recognise(input)) {
+                Dawg::WideDawg wide;
+                load(wide, input);
+                auto letters = alphabet ? alphabet.get() : wide.alphabet();
+                truncated = !Dawg::Query(constraints, letters).parallel(threads(args), !args.has("unordered")).limit(limits(args))
+                    .run(wide.view(), [&](std::string const& word) { std::cout << letters->decode(word) << "\n"; });
+            }
+            else {
+                Dawg::Lexicon lexicon(input);
+                truncated = !Dawg::Query(constraints, alphabet.get()).parallel(threads(args), !args.has("unordered"))
+                    .limit(limits(args)).run(lexicon.view(), [&](std::string const& word) {
+                        std::cout << decoded(word) << "\n";
+                    });
+            }
+        }
+        else if (command == "search" && Dawg::WideDawg::recognise(input)) {
+            Dawg::WideDawg wide;
+            load(wide, input);
+            truncated = !Dawg::BasicSearch<Dawg::WideLayout>(wide.view(), alphabet ? alphabet.get() : wide.alphabet())
+                .parallel(threads(args), !args.has("unordered"))
+                .limit(limits(args))
+                .run(output, args[3], [](std::string const& word) { std::cout << word << "\n"; });
+        }
+        else if (command == "search") {
+            Dawg::Lexicon lexicon(input);
+            truncated = !Dawg::Search(lexicon.view(), alphabet.get())
+                .parallel(threads(args), !args.has("unordered"))
+                .limit(limits(args))
+                .run(output, args[3], [](std::string const& word) { std::cout << word << "\n"; });
+        }
+        else if (command == "page") {
+            auto print = [](std::string const& word) { std::cout << word << "\n"; };
+            auto size = std::stoul(args[4]);
+            std::string next = args[5];
+            if (Dawg::WideDawg::recognise(input)) {
+                Dawg::WideDawg wide;
+                load(wide, input);
+                truncated = !Dawg::BasicSearch<Dawg::WideLayout>(wide.view(), alphabet ? alphabet.get() : wide.alphabet())
+                    .limit(limits(args))
+                    .page(output, args[3], next, size, print, args.option("from"));
+            }
+            else {
+                Dawg::Lexicon lexicon(input);
+                truncated = !Dawg::Search(lexicon.view(), alphabet.get())
+                    .limit(limits(args))
+                    .identify(lexicon.fingerprint())
+                    .page(output, args[3], next, size, print, args.option("from"));
+            }
+            if (!next.empty()) {
+                std::cout << "cursor " << next << "\n";
+            }
+        }
+        else if (command == "segment") {
+            Dawg::Lexicon lexicon(input);
+            Dawg::Segmenter segmenter(lexicon.view(), fold(args));
+
+            // Read the lines in batches, each of which is split in parallel
+            std::ifstream file;
+            if (!output.empty() && output != "-") {
+                file.open(output, std::ios::in);
+            }
+            std::istream& in = file.is_open() ? file : std::cin;
+            std::vector<std::string> lines;
+            for (bool more = true; more; ) {
+                lines.clear();
+                std::string line;
+                while (lines.size() < 65536 && (more = bool(std::getline(in, line)))) {
+                    lines.push_back(line);
+                }
+                for (auto const& split : segmenter.split(lines)) {
+                    std::cout << split << "\n";
+                }
+            }
+        }
+        else if (command == "scan") {
+            Dawg::Lexicon lexicon(input);
+            Dawg::Scanner scanner(lexicon.view(), fold(args), args.has("tokens"));
+            // An empty text cannot be mapped and has nothing in it, but a missing one is an error
+            struct stat st;
+            if (::stat(output.c_str(), &st) != 0 || st.st_size > 0) {
+                Dawg::MappedFile text(output);
+                scanner.scan(text.data(), text.size(), [&](size_t offset, size_t length) {
+                    std::cout << offset << "\t";
+                    std::cout.write(text.data() + offset, length) << "\n";
+                });
+            }
+        }
+        else if (command == "serve") {
+            Dawg::Server(args.lexicons(2), limits(args))
+                .limitConnections(std::stoul(args.option("connections", "64")))
+                .run(input);
+        }
+        else if (command == "request") {
+            std::cout << Dawg::Server::request(input, output + " " + args[3] + " " + args[4]);
+        }
+        else if (command == "publish") {
+            std::vector<std::unique_ptr<Dawg::Lexicon>> loaded;
+            std::vector<std::pair<std::string, Dawg::View>> lexicons;
+            for (auto const& entry : args.lexicons(2)) {
+                loaded.emplace_back(new Dawg::Lexicon(entry.second));
+                lexicons.emplace_back(entry.first, loaded.back()->view());
+            }
+            Dawg::Registry::publish(input, lexicons);
+        }
+        else if (command == "unpublish") {
+            Dawg::Registry::unpublish(input);
+        }
+        else if (command == "pack") {
+            std::vector<std::unique_ptr<Dawg::Lexicon>> loaded;
+            std::vector<std::pair<std::string, Dawg::View>> lexicons;
+            for (auto const& entry : args.lexicons(2)) {
+                loaded.emplace_back(new Dawg::Lexicon(entry.second));
+                lexicons.emplace_back(entry.first, loaded.back()->view());
+            }
+            Dawg::Registry::pack(input, lexicons);
+        }
+        else if (command == "registry") {
+            Dawg::Registry registry(input, args.has("archive"));
+            for (auto const& entry : registry.lexicons()) {
+                std::cout << entry.first << "\t" << entry.second.size() << "\t" << entry.second.checksum() << "\n";
+            }
+        }
+        else if (command == "emit-cpp") {
+            // The identifier defaults to the file name, minus anything that cannot be in one
+            std::string name { args.option("name") };
+            if (name.empty()) {
+                for (char c : input.substr(input.find_last_of('/') + 1)) {
+                    if (c == '.') {
+                        break;
+                    }
+                    name.push_back(std::isalnum(static_cast<unsigned char>(c)) ? c : '_');
+                }
+                if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+                    name.insert(0, "lexicon_");
+                }
+            }
+            Dawg::Lexicon lexicon(input);
+            std::ofstream out(output, std::ios::out);
+            Dawg::emitCpp(lexicon.view(), name, input.substr(input.find_last_of('/') + 1), out ? out : std::cout);
+        }
         else {
             std::cerr << "Unknown command (" << command << ").  Possible commands:\n\n"
-                << "Syntax: zyzzyva-dawg create <input text file | '-'> <output DAWG file>\n"
-                << "Syntax: zyzzyva-dawg dump <input DAWG file> [<output text file>]\n"
+                << "Syntax: zyzzyva-dawg create [--share-tails] [--alphabet <file>] [--format zyzzyva|wide] <input text file | '-'> <output DAWG file>\n"
+                << "Syntax: zyzzyva-dawg minimize [--share-tails] <input DAWG file> <output DAWG file>\n"
+                << "Syntax: zyzzyva-dawg filter [--len N|M-N] [--exclude <letters>] [--prefix <letters>] [--share-tails] <input DAWG file> <output DAWG file>\n"
+                << "Syntax: zyzzyva-dawg compress <input DAWG file> <output compressed DAWG file>\n"
+                << "Syntax: zyzzyva-dawg dump [--alphabet <file>] <input DAWG file> [<output text file>]\n"
                 << "Syntax: zyzzyva-dawg checksum <input DAWG file> [<output textual checksum>]\n"
+                << "Syntax: zyzzyva-dawg stats <input DAWG file> [<output text file>]\n"
+                << "Syntax: zyzzyva-dawg infixes <input DAWG file> <output infix index>\n"
+                << "Syntax: zyzzyva-dawg infix [--alphabet <file>] [--index <infix index>] [<limits>] <input DAWG file> <letters> [<output text file>]\n"
+                << "Syntax: zyzzyva-dawg suffix [--alphabet <file>] [--index <infix index>] [<limits>] <input DAWG file> <letters> [<output text file>]\n"
+                << "    which build the infix index in memory unless one is given\n"
+                << "Syntax: zyzzyva-dawg alphagrams <input DAWG file> <output alphagram index>\n"
+                << "Syntax: zyzzyva-dawg anagrams [--alphabet <file>] [<limits>] <input DAWG file> <alphagram index> <letters> [<output text file>]\n"
+                << "Syntax: zyzzyva-dawg neighbours <input DAWG file> <output neighbour index>\n"
+                << "Syntax: zyzzyva-dawg changes [--alphabet <file>] [<limits>] <input DAWG file> <neighbour index> <word> [<output text file>]\n"
+                << "Syntax: zyzzyva-dawg search [--alphabet <file>] [--threads N] [--unordered] [<limits>] <input DAWG file> <lookup|prefix|pattern|anagram> <argument>\n"
+                << "Syntax: zyzzyva-dawg page [--alphabet <file>] [--from <word>] <input DAWG file> <prefix|pattern|anagram> <argument> <count> [<cursor>]\n"
+                << "    which ends with a line \"cursor <cursor>\" to pass for the next page while there may be more\n"
+                << "Syntax: zyzzyva-dawg segment <input DAWG file> [--fold upper|lower] [<input text file | '-'>]\n"
+                << "Syntax: zyzzyva-dawg scan <input DAWG file> [--fold upper|lower] [--tokens] <input text file>\n"
+                << "Syntax: zyzzyva-dawg query [--alphabet <file>] [--threads N] [--unordered] [<limits>] <input DAWG file> <constraint>...\n"
+                << "    where each constraint is len:N or len:M-N, prefix:<letters>, pattern:<pattern>,\n"
+                << "    letters:<letters, with ? for a blank>, in:<DAWG file> or not-in:<DAWG file>\n"
+                << "    and <limits> are any of --timeout <milliseconds>, --max-nodes N and --max-results N,\n"
+                << "    where 0 is no limit, and a search stopped by one exits with status 2; with --threads,\n"
+                << "    --max-results keeps the first results found, which are not always the first in order\n"
+                << "Syntax: zyzzyva-dawg serve [<limits>] [--connections N] <socket> <[name=]DAWG file>...\n"
+                << "Syntax: zyzzyva-dawg request <socket> <lookup|prefix|pattern|anagram> <lexicon> <argument>\n"
+                << "Syntax: zyzzyva-dawg emit-cpp <input DAWG file> [--name <identifier>] [<output C++ header>]\n"
+                << "Syntax: zyzzyva-dawg publish <shared memory segment> <[name=]DAWG file>...\n"
+                << "Syntax: zyzzyva-dawg unpublish <shared memory segment>\n"
+                << "Syntax: zyzzyva-dawg registry <shared memory segment>\n"
+                << "Syntax: zyzzyva-dawg pack <output archive> <[name=]DAWG file>...\n"
+                << "Syntax: zyzzyva-dawg registry --archive <archive>\n"
+                << "Syntax: zyzzyva-dawg probability [--alphabet <file> --tiles <file>] [--length N] [--blanks N] [--table <output rank table>] <input DAWG file> [<output text file>]\n"
+                << "    where the tiles file gives each letter and its number of tiles (at most 63), one to a line, and\n"
+                << "    words with as many ways to draw them share a rank\n"
+                << "\n"
+                << "Commands that read a DAWG file can instead attach to a published lexicon as shm:<segment>:<name>\n"
+                << "or map one from an archive as pack:<archive>:<name>\n"
                 << "\n";
         }
 
+        if (truncated) {
+            std::cerr << "Search stopped at a limit, so the results are incomplete\n";
+            return 2;
+        }
         return 0;
     }
     catch (std::exception const& e) {
@@ -318,3 +4675,5 @@ int main(int argc, char *argv[])
         return 1;
     }
 }
+
+#endif // ZYZZYVA_DAWG_LIBRARY
@@ -0,0 +1,86 @@
+/** C interface to the DAWG query code
+ *
+ *  This allows the lexicon queries to be embedded directly in programs written
+ *  in other languages.  The queries run over the same node array that the
+ *  zyzzyva-dawg program reads and writes, either mapped straight from a DAWG
+ *  file or in a buffer supplied by the caller, and each result is written into
+ *  a buffer supplied by the caller, so no memory is allocated per result.
+ *
+ *  This code is Copyright (C) Stewart Brodie, 2019
+ */
+
+#ifndef ZYZZYVA_DAWG_H
+#define ZYZZYVA_DAWG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct zdawg zdawg;
+
+/* Called with each result in turn.  The word is NUL-terminated in the caller's
+ * buffer and is only valid until the callback returns.  Return non-zero to stop
+ * the search early.
+ */
+typedef int (*zdawg_word_fn)(void *context, char const *word, size_t length);
+
+/* Map a DAWG file into memory, attach to "shm:<segment>:<name>", or map a
+ * lexicon from an archive as "pack:<archive>:<name>".  Returns NULL if the file
+ * cannot be opened or is corrupt.
+ */
+zdawg *zdawg_open(char const *path);
+
+/* Use a node array that the caller has already placed in memory, such as the
+ * contents of a DAWG file after its leading count.  The array must outlive the
+ * handle.  Returns NULL on failure.
+ */
+zdawg *zdawg_open_memory(uint32_t const *nodes, size_t count);
+
+void zdawg_close(zdawg *dawg);
+
+/* Read and write words in the letters of an alphabet, given as the text of an
+ * alphabet file, for a lexicon that was created with one; otherwise words are
+ * the bytes stored in the lexicon.  Returns 0, or -1 if the alphabet is invalid.
+ */
+int zdawg_alphabet(zdawg *dawg, char const *definition);
+
+/* Returns 1 if the word is in the lexicon, 0 if not, or -1 on error. */
+int zdawg_lookup(zdawg const *dawg, char const *word);
+
+/* Each of these searches calls fn with every matching word, in lexicon order,
+ * and returns the number of words reported, or -1 on error (including a word
+ * too long for the buffer, or an invalid pattern).
+ *
+ * zdawg_prefix finds the words beginning with the prefix.
+ * zdawg_pattern finds the words matching a pattern, where '?' is any letter,
+ *   '*' is any run of letters and [ABC] is any one of the letters listed.
+ * zdawg_anagram finds the words using exactly the letters given, where '?' is
+ *   a blank.
+ */
+long zdawg_prefix(zdawg const *dawg, char const *prefix, char *buffer, size_t size, zdawg_word_fn fn, void *context);
+long zdawg_pattern(zdawg const *dawg, char const *pattern, char *buffer, size_t size, zdawg_word_fn fn, void *context);
+long zdawg_anagram(zdawg const *dawg, char const *letters, char *buffer, size_t size, zdawg_word_fn fn, void *context);
+
+/* Bounds on the work a search may do, where 0 means no limit */
+typedef struct zdawg_limits {
+    unsigned long timeout_ms;
+    unsigned long max_nodes;
+    unsigned long max_results;
+} zdawg_limits;
+
+/* Run a search named by query ("lookup", "prefix", "pattern", "anagram" or
+ * "query", which takes the constraints of the query command) within limits,
+ * which may be NULL.  Returns as the searches above do, and sets *truncated, if
+ * given, to 1 if a limit stopped the search with only some of the results.
+ */
+long zdawg_search(zdawg const *dawg, char const *query, char const *argument, zdawg_limits const *limits,
+                  int *truncated, char *buffer, size_t size, zdawg_word_fn fn, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif